@@ -0,0 +1,86 @@
+
+/**
+ ** Native checksum microbenchmark.
+ **
+ ** Runs the addon's checksum routine over a range of buffer sizes for a fixed
+ ** amount of time each and prints the results to stdout as a JSON object, it
+ ** is built as the raw_bench target by node-gyp and driven by bench/index.js:
+ **
+ **   raw_bench [milliseconds-per-size] [size,size,...]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../src/checksum.h"
+
+static const size_t default_sizes[] = {20, 64, 512, 1500, 9000, 65535};
+
+int main (int argc, char **argv) {
+	unsigned int milliseconds = 500;
+	std::vector<size_t> sizes;
+
+	if (argc > 1)
+		milliseconds = (unsigned int) strtoul (argv[1], NULL, 10);
+
+	if (argc > 2) {
+		char *list = argv[2];
+		char *token;
+		while ((token = strtok (list, ",")) != NULL) {
+			sizes.push_back ((size_t) strtoul (token, NULL, 10));
+			list = NULL;
+		}
+	} else {
+		sizes.assign (default_sizes, default_sizes
+				+ sizeof (default_sizes) / sizeof (default_sizes[0]));
+	}
+
+	printf ("{\"suite\":\"checksum\",\"impl\":\"native\",\"results\":[");
+
+	for (size_t s = 0; s < sizes.size (); s++) {
+		size_t size = sizes[s];
+		std::vector<unsigned char> buffer (size + 1);
+		for (size_t i = 0; i < size; i++)
+			buffer[i] = (unsigned char) (i * 31 + 7);
+
+		/**
+		 ** Fold every result into the next start value so the compiler
+		 ** cannot hoist the call out of the loop.
+		 **/
+		volatile uint16_t sink = 0;
+		uint64_t iterations = 0;
+		uint16_t sum = 0;
+
+		std::chrono::steady_clock::time_point start
+				= std::chrono::steady_clock::now ();
+		std::chrono::steady_clock::time_point end = start
+				+ std::chrono::milliseconds (milliseconds);
+		std::chrono::steady_clock::time_point now = start;
+
+		while (now < end) {
+			for (unsigned int i = 0; i < 256; i++)
+				sum = checksum (sum, &buffer[0], size);
+			iterations += 256;
+			now = std::chrono::steady_clock::now ();
+		}
+		sink = sum;
+		(void) sink;
+
+		double seconds = std::chrono::duration<double> (now - start).count ();
+
+		printf ("%s{\"size\":%lu,\"iterations\":%llu,\"seconds\":%.6f,"
+				"\"nsPerOp\":%.3f,\"bytesPerSecond\":%.0f}",
+				s ? "," : "", (unsigned long) size,
+				(unsigned long long) iterations, seconds,
+				seconds * 1e9 / (double) iterations,
+				(double) size * (double) iterations / seconds);
+	}
+
+	printf ("]}\n");
+
+	return 0;
+}
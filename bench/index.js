@@ -0,0 +1,295 @@
+
+/**
+ ** Benchmark runner, started using "npm run bench".  Results are written to
+ ** stdout (or the file given by --output) as a single JSON document, progress
+ ** is written to stderr.  Options, all optional:
+ **
+ **   --duration=<ms>        time spent on each measurement, default 2000
+ **   --suites=<list>        checksum,send,recv,latency
+ **   --paths=<list>         loopback,veth,tun
+ **   --families=<list>      ipv4,ipv6
+ **   --modes=<list>         single,batched
+ **   --engines=<list>       poll,uring
+ **   --batch=<n>            requests kept outstanding in batched mode, 64
+ **   --size=<bytes>         packet payload size, default 64
+ **   --output=<file>        write the JSON report to a file
+ **
+ ** Socket benchmarks require the privileges needed to open raw sockets, and
+ ** the veth and tun paths additionally require root and iproute2.  The tun
+ ** path has no latency benchmark, nothing answers on the far end of the
+ ** device.  Measurements that cannot run are reported with a "skipped"
+ ** reason instead of failing the run.
+ **/
+
+var child_process = require ("child_process");
+var fs = require ("fs");
+var os = require ("os");
+var path = require ("path");
+
+var raw = require ("../");
+var netns = require ("./netns");
+var socket = require ("./socket");
+var tun = require ("./tun");
+
+var config = {
+	duration: 2000,
+	suites: ["checksum", "send", "recv", "latency"],
+	paths: ["loopback", "veth", "tun"],
+	families: ["ipv4", "ipv6"],
+	modes: ["single", "batched"],
+	engines: ["poll", "uring"],
+	batch: 64,
+	size: 64,
+	output: null
+};
+
+var CHECKSUM_SIZES = [20, 64, 512, 1500, 9000, 65535];
+
+function parseArguments (argv) {
+	for (var i = 0; i < argv.length; i++) {
+		var match = /^--([a-z]+)=(.*)$/.exec (argv[i]);
+		if (! match || ! (match[1] in config)) {
+			console.error ("unknown argument '" + argv[i] + "'");
+			process.exit (-1);
+		}
+		var current = config[match[1]];
+		if (Array.isArray (current))
+			config[match[1]] = match[2].split (",");
+		else if (typeof current == "number")
+			config[match[1]] = parseInt (match[2]);
+		else
+			config[match[1]] = match[2];
+	}
+}
+
+function log (message) {
+	process.stderr.write (message + "\n");
+}
+
+function has (list, item) {
+	return list.indexOf (item) >= 0;
+}
+
+function nativeChecksum () {
+	var executable = path.join (__dirname, "..", "build", "Release",
+			"raw_bench" + (process.platform == "win32" ? ".exe" : ""));
+	try {
+		var output = child_process.execFileSync (executable,
+				["" + Math.max (1, Math.floor (config.duration / 4)),
+				CHECKSUM_SIZES.join (",")]);
+		return JSON.parse (output.toString ());
+	} catch (error) {
+		return {suite: "checksum", impl: "native", skipped: error.message};
+	}
+}
+
+function jsChecksum () {
+	var results = [];
+	var duration = BigInt (Math.max (1, Math.floor (config.duration / 4)))
+			* 1000000n;
+
+	for (var i = 0; i < CHECKSUM_SIZES.length; i++) {
+		var size = CHECKSUM_SIZES[i];
+		var buffer = Buffer.alloc (size);
+		for (var j = 0; j < size; j++)
+			buffer[j] = (j * 31 + 7) & 0xff;
+
+		var iterations = 0;
+		var start = process.hrtime.bigint ();
+		var now = start;
+		while (now - start < duration) {
+			for (var k = 0; k < 256; k++)
+				raw.createChecksum (buffer);
+			iterations += 256;
+			now = process.hrtime.bigint ();
+		}
+
+		var seconds = Number (now - start) / 1e9;
+		results.push ({
+			size: size,
+			iterations: iterations,
+			seconds: seconds,
+			nsPerOp: (seconds * 1e9) / iterations,
+			bytesPerSecond: (size * iterations) / seconds
+		});
+	}
+
+	return {suite: "checksum", impl: "js", results: results};
+}
+
+function socketPlan (network, device) {
+	var plan = [];
+
+	config.paths.forEach (function (pathName) {
+		config.families.forEach (function (family) {
+			var local;
+			var peer;
+			var exec = null;
+
+			/**
+			 ** Send and latency benchmarks target the peer, the receive
+			 ** benchmark has the peer flood the local address.
+			 **/
+			if (pathName == "loopback") {
+				local = peer = family == "ipv6" ? "::1" : "127.0.0.1";
+			} else if (pathName == "tun") {
+				if (! device)
+					return;
+				local = device.addresses[family].local;
+				peer = device.addresses[family].peer;
+			} else {
+				if (! network)
+					return;
+				local = network.addresses[family].local;
+				peer = network.addresses[family].peer;
+				exec = network.exec;
+			}
+
+			["send", "recv", "latency"].forEach (function (suite) {
+				if (! has (config.suites, suite))
+					return;
+				if (pathName == "tun" && suite == "latency")
+					return;
+
+				config.engines.forEach (function (engine) {
+					config.modes.forEach (function (mode) {
+						/**
+						 ** The receive benchmark is driven by a separate
+						 ** flood process, it has no single or batched variant
+						 ** of its own so only run it once per engine.
+						 **/
+						if (suite == "recv" && mode != config.modes[0])
+							return;
+
+						plan.push ({
+							suite: suite,
+							path: pathName,
+							family: family,
+							mode: suite == "recv" ? null : mode,
+							engine: engine,
+							options: {
+								family: family,
+								engine: engine,
+								mode: mode,
+								batch: config.batch,
+								size: config.size,
+								duration: config.duration,
+								target: suite == "recv" ? local : peer,
+								source: peer,
+								exec: suite == "recv" ? exec : null,
+								tun: pathName == "tun" ? device.device : null
+							}
+						});
+					});
+				});
+			});
+		});
+	});
+
+	return plan;
+}
+
+function runPlan (plan, results, callback) {
+	if (plan.length == 0)
+		return callback ();
+
+	var entry = plan.shift ();
+	var runner = entry.suite == "send" ? socket.sendRate
+			: (entry.suite == "recv" ? socket.recvRate : socket.latency);
+	var options = entry.options;
+	delete entry.options;
+
+	log ("running " + entry.suite + " " + entry.path + " " + entry.family
+			+ " " + entry.engine + (entry.mode ? " " + entry.mode : ""));
+
+	function record (error, result) {
+		if (error) {
+			entry.skipped = error.message;
+		} else {
+			/**
+			 ** Report the engine actually used, a socket quietly falls back
+			 ** to polling when io_uring is not available.
+			 **/
+			entry.engine = result.engine;
+			delete result.engine;
+			entry.result = result;
+		}
+		results.push (entry);
+		setImmediate (runPlan, plan, results, callback);
+	}
+
+	try {
+		runner (options, record);
+	} catch (error) {
+		record (error);
+	}
+}
+
+function main () {
+	parseArguments (process.argv.slice (2));
+
+	var report = {
+		timestamp: new Date ().toISOString (),
+		node: process.version,
+		platform: process.platform,
+		arch: process.arch,
+		release: os.release (),
+		cpus: os.cpus ().length,
+		config: config,
+		results: []
+	};
+
+	if (has (config.suites, "checksum")) {
+		log ("running checksum native");
+		report.results.push (nativeChecksum ());
+		log ("running checksum js");
+		report.results.push (jsChecksum ());
+	}
+
+	var network = null;
+	if (has (config.paths, "veth")
+			&& (has (config.suites, "send") || has (config.suites, "recv")
+			|| has (config.suites, "latency"))) {
+		try {
+			network = netns.setup ();
+		} catch (error) {
+			report.results.push ({path: "veth", skipped: error.message});
+		}
+	}
+
+	var device = null;
+	if (has (config.paths, "tun")
+			&& (has (config.suites, "send") || has (config.suites, "recv"))) {
+		try {
+			device = tun.setup ();
+		} catch (error) {
+			report.results.push ({path: "tun", skipped: error.message});
+		}
+	}
+
+	function cleanup () {
+		if (network)
+			netns.teardown ();
+		if (device)
+			tun.teardown ();
+		network = null;
+		device = null;
+	}
+
+	process.on ("SIGINT", function () {
+		cleanup ();
+		process.exit (-1);
+	});
+
+	runPlan (socketPlan (network, device), report.results, function () {
+		cleanup ();
+
+		var json = JSON.stringify (report, null, 2);
+		if (config.output)
+			fs.writeFileSync (config.output, json + "\n");
+		else
+			process.stdout.write (json + "\n");
+	});
+}
+
+main ();
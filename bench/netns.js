@@ -0,0 +1,73 @@
+
+/**
+ ** Creates and removes a veth pair with one end moved into a dedicated
+ ** network namespace, so traffic between the two ends crosses a real network
+ ** device instead of the loopback interface.  Requires root and the iproute2
+ ** "ip" command.
+ **/
+
+var child_process = require ("child_process");
+
+var NAMESPACE = "rawbench";
+var LOCAL_LINK = "rawbench0";
+var PEER_LINK = "rawbench1";
+
+var addresses = {
+	ipv4: {local: "10.203.0.1", peer: "10.203.0.2", prefix: 30},
+	ipv6: {local: "fd00:cb::1", peer: "fd00:cb::2", prefix: 64}
+};
+
+function ip (args, ignoreErrors) {
+	try {
+		child_process.execFileSync ("ip", args, {stdio: "pipe"});
+	} catch (error) {
+		if (! ignoreErrors)
+			throw new Error ("ip " + args.join (" ") + ": "
+					+ (error.stderr ? error.stderr.toString ().trim ()
+					: error.message));
+	}
+}
+
+function setup () {
+	teardown ();
+
+	ip (["netns", "add", NAMESPACE]);
+	ip (["link", "add", LOCAL_LINK, "type", "veth", "peer", "name", PEER_LINK]);
+	ip (["link", "set", PEER_LINK, "netns", NAMESPACE]);
+
+	ip (["addr", "add", addresses.ipv4.local + "/" + addresses.ipv4.prefix,
+			"dev", LOCAL_LINK]);
+	ip (["addr", "add", addresses.ipv6.local + "/" + addresses.ipv6.prefix,
+			"dev", LOCAL_LINK, "nodad"]);
+	ip (["link", "set", LOCAL_LINK, "up"]);
+
+	ip (["netns", "exec", NAMESPACE, "ip", "addr", "add",
+			addresses.ipv4.peer + "/" + addresses.ipv4.prefix, "dev", PEER_LINK]);
+	ip (["netns", "exec", NAMESPACE, "ip", "addr", "add",
+			addresses.ipv6.peer + "/" + addresses.ipv6.prefix, "dev", PEER_LINK,
+			"nodad"]);
+	ip (["netns", "exec", NAMESPACE, "ip", "link", "set", PEER_LINK, "up"]);
+	ip (["netns", "exec", NAMESPACE, "ip", "link", "set", "lo", "up"]);
+
+	return {
+		addresses: addresses,
+
+		/**
+		 ** Command prefix used to run a process on the far side of the pair.
+		 **/
+		exec: ["ip", "netns", "exec", NAMESPACE]
+	};
+}
+
+function teardown () {
+	/**
+	 ** Deleting the namespace destroys the peer end, which in turn destroys
+	 ** the local end of the pair, but be explicit in case a previous run was
+	 ** interrupted half way through setup.
+	 **/
+	ip (["netns", "del", NAMESPACE], true);
+	ip (["link", "del", LOCAL_LINK], true);
+}
+
+exports.setup = setup;
+exports.teardown = teardown;
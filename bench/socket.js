@@ -0,0 +1,332 @@
+
+/**
+ ** Socket level benchmarks: send rate, receive rate and ICMP echo round trip
+ ** latency.  Each benchmark takes an options object and calls back with a
+ ** plain result object which bench/index.js collects into its JSON report.
+ **
+ ** When run directly this file acts as the flood sender used by the receive
+ ** rate benchmark, so it can be started in another process (and another
+ ** network namespace) by the parent:
+ **
+ **   node socket.js flood <ipv4|ipv6> <target> <size> <milliseconds>
+ **/
+
+var child_process = require ("child_process");
+var raw = require ("../");
+var tun = require ("./tun");
+
+/**
+ ** IANA reserves protocol 253 for experimentation, nothing on the host should
+ ** be listening for it, so it makes a quiet protocol for rate benchmarks.
+ **/
+var BENCH_PROTOCOL = 253;
+
+function family (name) {
+	return name == "ipv6" ? raw.AddressFamily.IPv6 : raw.AddressFamily.IPv4;
+}
+
+function engine (name) {
+	return name == "uring" ? raw.Engine.Uring : raw.Engine.Poll;
+}
+
+function engineName (socket) {
+	return socket.engine == raw.Engine.Uring ? "uring" : "poll";
+}
+
+function socketOptions (options, protocol) {
+	return {
+		protocol: protocol,
+		addressFamily: family (options.family),
+		engine: engine (options.engine),
+		bufferSize: Math.max (4096, (options.size || 0) + 128),
+		tun: options.tun || null
+	};
+}
+
+function now () {
+	return process.hrtime.bigint ();
+}
+
+function seconds (start, end) {
+	return Number (end - start) / 1e9;
+}
+
+function percentile (sorted, p) {
+	if (sorted.length == 0)
+		return null;
+	var index = Math.min (sorted.length - 1,
+			Math.ceil ((p / 100) * sorted.length) - 1);
+	return sorted[Math.max (0, index)];
+}
+
+function summarise (samples) {
+	var sorted = samples.slice ().sort (function (a, b) { return a - b; });
+	var total = 0;
+	for (var i = 0; i < sorted.length; i++)
+		total += sorted[i];
+	return {
+		samples: sorted.length,
+		min: sorted.length ? sorted[0] : null,
+		mean: sorted.length ? total / sorted.length : null,
+		p50: percentile (sorted, 50),
+		p90: percentile (sorted, 90),
+		p99: percentile (sorted, 99),
+		p999: percentile (sorted, 99.9),
+		max: sorted.length ? sorted[sorted.length - 1] : null
+	};
+}
+
+function depth (options) {
+	return options.mode == "batched" ? options.batch : 1;
+}
+
+function sendRate (options, callback) {
+	var socket = raw.createSocket (socketOptions (options, BENCH_PROTOCOL));
+	var buffer = options.tun
+			? tun.packet (options.family, BENCH_PROTOCOL, options.size)
+			: Buffer.alloc (options.size, 0x61);
+	var sent = 0;
+	var errors = 0;
+	var outstanding = 0;
+	var done = false;
+	var start = now ();
+
+	function fill () {
+		while (! done && outstanding < depth (options)) {
+			outstanding++;
+			socket.send (buffer, 0, buffer.length, options.target, onSent);
+		}
+	}
+
+	function onSent (error, bytes) {
+		outstanding--;
+		if (error)
+			errors++;
+		else
+			sent++;
+		fill ();
+	}
+
+	socket.on ("error", function (error) {
+		done = true;
+		callback (error);
+	});
+
+	setTimeout (function () {
+		var elapsed = seconds (start, now ());
+		done = true;
+		socket.close ();
+		callback (null, {
+			engine: engineName (socket),
+			packets: sent,
+			errors: errors,
+			seconds: elapsed,
+			pps: sent / elapsed,
+			bitsPerSecond: (sent * options.size * 8) / elapsed
+		});
+	}, options.duration);
+
+	fill ();
+}
+
+function recvRate (options, callback) {
+	var socket = raw.createSocket (socketOptions (options, BENCH_PROTOCOL));
+	var received = 0;
+	var bytes = 0;
+	var first = null;
+	var last = null;
+	var finished = false;
+
+	socket.on ("message", function (buffer, source) {
+		if (source != options.source)
+			return;
+		if (first === null)
+			first = now ();
+		last = now ();
+		received++;
+		bytes += buffer.length;
+	});
+
+	var args = (options.exec || []).concat ([process.execPath, __filename,
+			"flood", options.family, options.target, "" + options.size,
+			"" + options.duration]);
+	var sender = child_process.spawn (args[0], args.slice (1),
+			{stdio: ["ignore", "ignore", "pipe"]});
+	var stderr = "";
+
+	sender.stderr.on ("data", function (data) {
+		stderr += data.toString ();
+	});
+
+	function finish (error) {
+		if (finished)
+			return;
+		finished = true;
+		socket.close ();
+		if (error)
+			return callback (error);
+		var elapsed = (first !== null && last > first) ? seconds (first, last) : 0;
+		callback (null, {
+			engine: engineName (socket),
+			packets: received,
+			bytes: bytes,
+			seconds: elapsed,
+			pps: elapsed ? received / elapsed : 0,
+			bitsPerSecond: elapsed ? (bytes * 8) / elapsed : 0
+		});
+	}
+
+	sender.on ("error", finish);
+	sender.on ("exit", function (code) {
+		/**
+		 ** Give the receiver a moment to drain what is still queued on the
+		 ** socket once the sender has stopped.
+		 **/
+		setTimeout (function () {
+			finish (code ? new Error ("flood sender exited with code " + code
+					+ ": " + stderr.trim ()) : null);
+		}, 100);
+	});
+}
+
+function flood (familyName, target, size, duration) {
+	var socket = raw.createSocket (socketOptions ({family: familyName},
+			BENCH_PROTOCOL));
+	var buffer = Buffer.alloc (size, 0x62);
+	var done = false;
+	var outstanding = 0;
+
+	socket.pauseRecv ();
+
+	function fill () {
+		while (! done && outstanding < 64) {
+			outstanding++;
+			socket.send (buffer, 0, buffer.length, target, onSent);
+		}
+	}
+
+	function onSent () {
+		outstanding--;
+		fill ();
+	}
+
+	setTimeout (function () {
+		done = true;
+		socket.close ();
+	}, duration);
+
+	fill ();
+}
+
+function latency (options, callback) {
+	var ipv6 = options.family == "ipv6";
+	var socket = raw.createSocket (socketOptions (options,
+			ipv6 ? raw.Protocol.ICMPv6 : raw.Protocol.ICMP));
+	var identifier = process.pid & 0xffff;
+	var sequence = 0;
+	var pending = {};
+	var outstanding = 0;
+	var samples = [];
+	var lost = 0;
+	var done = false;
+	var timer = null;
+
+	var request = Buffer.alloc (options.size < 8 ? 8 : options.size, 0x63);
+	request.writeUInt8 (ipv6 ? 128 : 8, 0);
+	request.writeUInt8 (0, 1);
+	request.writeUInt16BE (0, 2);
+	request.writeUInt16BE (identifier, 4);
+
+	function burst () {
+		clearTimeout (timer);
+		if (done)
+			return;
+
+		/**
+		 ** Anything still outstanding when a new burst starts is counted as
+		 ** lost, the burst timeout below guarantees we always move on.
+		 **/
+		for (var key in pending)
+			lost++;
+		pending = {};
+		outstanding = depth (options);
+
+		/**
+		 ** Sends are queued, so each request needs a buffer of its own.
+		 **/
+		for (var i = 0; i < outstanding; i++) {
+			var packet = Buffer.from (request);
+			sequence = (sequence + 1) & 0xffff;
+			packet.writeUInt16BE (sequence, 6);
+			if (! ipv6)
+				raw.writeChecksum (packet, 2, raw.createChecksum (packet));
+			pending[sequence] = now ();
+			socket.send (packet, 0, packet.length, options.target,
+					onSent.bind (null, sequence));
+		}
+
+		timer = setTimeout (burst, 1000);
+	}
+
+	/**
+	 ** A request which could not be sent is no longer pending, otherwise it
+	 ** would be counted as lost a second time when the next burst starts.
+	 **/
+	function onSent (seq, error) {
+		if (error && pending[seq] !== undefined) {
+			delete pending[seq];
+			lost++;
+			if (--outstanding == 0)
+				setImmediate (burst);
+		}
+	}
+
+	socket.on ("message", function (buffer, source) {
+		var offset = ipv6 ? 0 : (buffer[0] & 0x0f) * 4;
+		if (buffer.length < offset + 8)
+			return;
+		if (buffer[offset] != (ipv6 ? 129 : 0))
+			return;
+		if (buffer.readUInt16BE (offset + 4) != identifier)
+			return;
+
+		var seq = buffer.readUInt16BE (offset + 6);
+		var sent = pending[seq];
+		if (sent === undefined)
+			return;
+
+		delete pending[seq];
+		samples.push (Number (now () - sent) / 1e3);
+		if (--outstanding == 0)
+			burst ();
+	});
+
+	socket.on ("error", function (error) {
+		done = true;
+		clearTimeout (timer);
+		callback (error);
+	});
+
+	setTimeout (function () {
+		done = true;
+		clearTimeout (timer);
+		socket.close ();
+		var result = summarise (samples);
+		result.engine = engineName (socket);
+		result.unit = "microseconds";
+		result.lost = lost;
+		callback (null, result);
+	}, options.duration);
+
+	burst ();
+}
+
+exports.sendRate = sendRate;
+exports.recvRate = recvRate;
+exports.latency = latency;
+exports.summarise = summarise;
+
+if (require.main === module && process.argv[2] == "flood") {
+	flood (process.argv[3], process.argv[4], parseInt (process.argv[5]),
+			parseInt (process.argv[6]));
+}
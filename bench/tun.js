@@ -0,0 +1,91 @@
+
+/**
+ ** Creates and removes a persistent multi queue TUN device.  The benchmark
+ ** sockets attach queues to it and play the far end of the device, so the
+ ** host stack is exercised without any network at all.  Requires root and
+ ** the iproute2 "ip" command.
+ **/
+
+var child_process = require ("child_process");
+var raw = require ("../");
+
+var DEVICE = "rawbenchtun";
+
+/**
+ ** The local address belongs to the far end played by the benchmark socket,
+ ** the peer address is given to the device and so is the host itself.
+ **/
+var addresses = {
+	ipv4: {local: "10.204.0.2", peer: "10.204.0.1", prefix: 30,
+			bytes: {local: [10, 204, 0, 2], peer: [10, 204, 0, 1]}},
+	ipv6: {local: "fd00:cc::2", peer: "fd00:cc::1", prefix: 64,
+			bytes: {
+				local: [0xfd, 0, 0, 0xcc, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2],
+				peer: [0xfd, 0, 0, 0xcc, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1]
+			}}
+};
+
+function ip (args, ignoreErrors) {
+	try {
+		child_process.execFileSync ("ip", args, {stdio: "pipe"});
+	} catch (error) {
+		if (! ignoreErrors)
+			throw new Error ("ip " + args.join (" ") + ": "
+					+ (error.stderr ? error.stderr.toString ().trim ()
+					: error.message));
+	}
+}
+
+/**
+ ** Builds an IP packet from the far end to the host, TUN devices only ever
+ ** carry complete packets.
+ **/
+function packet (family, protocol, size) {
+	var bytes = addresses[family].bytes;
+	var header;
+
+	if (family == "ipv6") {
+		header = Buffer.alloc (40);
+		header.writeUInt8 (0x60, 0);
+		header.writeUInt16BE (size, 4);
+		header.writeUInt8 (protocol, 6);
+		header.writeUInt8 (64, 7);
+		Buffer.from (bytes.local).copy (header, 8);
+		Buffer.from (bytes.peer).copy (header, 24);
+	} else {
+		header = Buffer.alloc (20);
+		header.writeUInt8 (0x45, 0);
+		header.writeUInt16BE (20 + size, 2);
+		header.writeUInt8 (64, 8);
+		header.writeUInt8 (protocol, 9);
+		Buffer.from (bytes.local).copy (header, 12);
+		Buffer.from (bytes.peer).copy (header, 16);
+		raw.writeChecksum (header, 10, raw.createChecksum (header));
+	}
+
+	return Buffer.concat ([header, Buffer.alloc (size, 0x61)]);
+}
+
+function setup () {
+	teardown ();
+
+	ip (["tuntap", "add", "dev", DEVICE, "mode", "tun", "multi_queue"]);
+	ip (["addr", "add", addresses.ipv4.peer + "/" + addresses.ipv4.prefix,
+			"dev", DEVICE]);
+	ip (["addr", "add", addresses.ipv6.peer + "/" + addresses.ipv6.prefix,
+			"dev", DEVICE, "nodad"]);
+	ip (["link", "set", DEVICE, "up"]);
+
+	return {
+		addresses: addresses,
+		device: DEVICE
+	};
+}
+
+function teardown () {
+	ip (["tuntap", "del", "dev", DEVICE, "mode", "tun", "multi_queue"], true);
+}
+
+exports.packet = packet;
+exports.setup = setup;
+exports.teardown = teardown;
@@ -3,7 +3,11 @@
     {
       'target_name': 'raw',
       'sources': [
-        'src/raw.cc'
+        'src/capture.cc',
+        'src/raw.cc',
+        'src/reassembly.cc',
+        'src/scan.cc',
+        'src/uring.cc'
       ],
       "include_dirs" : [
         "<!(node -e \"require('nan')\")"
@@ -13,6 +17,18 @@
           'libraries' : ['ws2_32.lib']
         }]
       ]
+    },
+    {
+      'target_name': 'raw_bench',
+      'type': 'executable',
+      'sources': [
+        'bench/checksum.cc'
+      ],
+      'conditions' : [
+        ['OS=="win"', {
+          'libraries' : ['ws2_32.lib']
+        }]
+      ]
     }
   ]
 }
@@ -0,0 +1,77 @@
+
+var net = require ("net");
+var raw = require ("../");
+
+if (process.argv.length < 4) {
+	console.log ("node ping-group <sleep-milliseconds> <target> [<target> ...]");
+	process.exit (-1);
+}
+
+var sleep = parseInt (process.argv[2]);
+var targets = process.argv.slice (3);
+
+var group = raw.createSocketGroup ();
+
+group.on ("error", function (error) {
+	console.log ("error: " + error.toString ());
+	process.exit (-1);
+});
+
+// One event for the packets received on all of the groups sockets
+group.on ("messages", function (indexes, buffers, sources) {
+	console.log ("received " + indexes.length + " packets");
+	for (var i = 0; i < indexes.length; i++) {
+		var socket = group.sockets[indexes[i]];
+		console.log ("  " + buffers[i].length + " bytes from " + sources[i]
+				+ " on the socket for " + socket.target);
+	}
+});
+
+// ICMP echo (ping) request, the type is changed for ICMPv6
+var buffer = Buffer.from([
+		0x08, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x09,
+		0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70,
+		0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x61,
+		0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69]);
+
+raw.writeChecksum (buffer, 2, raw.createChecksum (buffer));
+
+var buffer6 = Buffer.from (buffer);
+buffer6.writeUInt8 (128, 0);
+buffer6.writeUInt16BE (0, 2);
+
+var sockets = targets.map (function (target) {
+	var options = net.isIPv6 (target)
+			? {protocol: raw.Protocol.ICMPv6, addressFamily: raw.AddressFamily.IPv6}
+			: {protocol: raw.Protocol.ICMP};
+
+	var socket = raw.createSocket (options);
+	socket.target = target;
+
+	socket.on ("error", function (error) {
+		console.log ("error: " + error.toString ());
+		process.exit (-1);
+	});
+
+	group.add (socket);
+	return socket;
+});
+
+function ping () {
+	sockets.forEach (function (socket) {
+		var request = net.isIPv6 (socket.target) ? buffer6 : buffer;
+		socket.send (request, 0, request.length, socket.target,
+				function (error, bytes) {
+			if (error) {
+				console.log (error.toString ());
+			} else {
+				console.log ("sent " + bytes + " bytes to " + socket.target);
+			}
+		});
+	});
+	
+	setTimeout (ping, sleep);
+}
+
+ping ();
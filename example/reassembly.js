@@ -0,0 +1,50 @@
+
+var raw = require ("../");
+
+if (process.argv.length < 3) {
+	console.log ("node reassembly <tun-device>");
+	process.exit (-1);
+}
+
+var name = process.argv[2];
+
+// The device must be configured, and brought up, using the normal tools,
+// e.g. "ip addr add 10.0.0.1/24 dev tun0 && ip link set tun0 up && ip link
+// set tun0 mtu 576", after which "ping -s 2000 10.0.0.2" sends fragments
+var options = {
+	tun: name
+};
+
+var socket = raw.createSocket (options);
+
+socket.on ("close", function () {
+	console.log ("socket closed");
+	process.exit (-1);
+});
+
+socket.on ("error", function (error) {
+	console.log ("error: " + error.toString ());
+	process.exit (-1);
+});
+
+socket.on ("message", function (buffer, source) {
+	var version = buffer[0] >> 4;
+	var length = version == 6
+			? 40 + buffer.readUInt16BE (4)
+			: buffer.readUInt16BE (2);
+	console.log ("received " + buffer.length + " bytes from " + source
+			+ ", IPv" + version + " length " + length);
+});
+
+socket.startReassembly ({memory: 4194304, timeout: 30000});
+
+console.log ("reading from " + socket.tun);
+
+setInterval (function () {
+	var stats = socket.reassemblyStats ();
+	console.log ("fragments " + stats.fragments + ", datagrams "
+			+ stats.datagrams + ", timeouts " + stats.timeouts
+			+ ", evictions " + stats.evictions + ", overlaps "
+			+ stats.overlaps + ", invalid " + stats.invalid + ", pending "
+			+ stats.pending);
+}, 5000);
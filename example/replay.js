@@ -0,0 +1,39 @@
+
+var raw = require ("../");
+
+if (process.argv.length < 4) {
+	console.log ("node replay <path> <rate> [<address>]");
+	process.exit (-1);
+}
+
+var path = process.argv[2];
+var rate = parseFloat (process.argv[3]);
+var address = process.argv[4];
+
+var options = {
+	protocol: raw.Protocol.ICMP
+};
+
+var socket = raw.createSocket (options);
+
+socket.on ("error", function (error) {
+	console.log ("error: " + error.toString ());
+	process.exit (-1);
+});
+
+socket.on ("message", function (buffer, source) {
+	console.log ("received " + buffer.length + " bytes from " + source);
+});
+
+// A rate of 2 replays twice as fast as captured, 0 as fast as possible
+socket.replay (path, {rate: rate, address: address}, function (error, stats) {
+	if (error) {
+		console.log ("error: " + error.toString ());
+	} else {
+		console.log ("replayed " + stats.packets + " packets, " + stats.bytes
+				+ " bytes, " + stats.skipped + " skipped, " + stats.errors
+				+ " errors");
+	}
+	socket.close ();
+	process.exit (0);
+});
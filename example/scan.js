@@ -0,0 +1,53 @@
+
+var net = require ("net");
+var raw = require ("../");
+
+if (process.argv.length < 5) {
+	console.log ("node scan <source> <targets> <ports> [<rate>]");
+	console.log ("  e.g. node scan 192.168.1.10 192.168.1.1,192.168.1.2 22,80,443");
+	console.log ("  the source address is only needed for IPv4, e.g. node scan - ::1 22");
+	process.exit (-1);
+}
+
+var source = process.argv[2] == "-" ? "" : process.argv[2];
+var targets = process.argv[3].split (",");
+var ports = process.argv[4].split (",").map (function (port) {
+	return parseInt (port);
+});
+var rate = process.argv[5] ? parseInt (process.argv[5]) : 0;
+
+var options = {
+	protocol: raw.Protocol.TCP,
+	addressFamily: net.isIPv6 (targets[0])
+			? raw.AddressFamily.IPv6
+			: raw.AddressFamily.IPv4
+};
+
+var socket = raw.createSocket (options);
+
+socket.on ("error", function (error) {
+	console.log ("error: " + error.toString ());
+	process.exit (-1);
+});
+
+// Other TCP packets received during the scan are ignored
+socket.on ("message", function (buffer, source) {});
+
+socket.on ("scanResults", function (results) {
+	results.forEach (function (result) {
+		console.log (result.address + ":" + result.port + " " + result.state);
+	});
+});
+
+socket.scan (targets, ports, {source: source, rate: rate, wait: 2000},
+		function (error, stats) {
+	if (error) {
+		console.log ("error: " + error.toString ());
+	} else {
+		console.log ("sent " + stats.sent + " probes, " + stats.open + " open, "
+				+ stats.closed + " closed, " + stats.invalid + " invalid, "
+				+ stats.errors + " errors");
+	}
+	socket.close ();
+	process.exit (0);
+});
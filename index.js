@@ -19,6 +19,13 @@ var AddressFamily = {
 
 _expandConstantObject (AddressFamily);
 
+var Engine = {
+	0: "Poll",
+	1: "Uring"
+};
+
+_expandConstantObject (Engine);
+
 var Protocol = {
 	0: "None",
 	1: "ICMP",
@@ -31,6 +38,8 @@ _expandConstantObject (Protocol);
 
 for (var key in events.EventEmitter.prototype) {
   raw.SocketWrap.prototype[key] = events.EventEmitter.prototype[key];
+  if (raw.SocketGroupWrap)
+    raw.SocketGroupWrap.prototype[key] = events.EventEmitter.prototype[key];
 }
 
 function Socket (options) {
@@ -41,6 +50,12 @@ function Socket (options) {
 			? options.bufferSize
 			: 4096);
 
+	this.flushScheduled = false;
+	this.closed = false;
+
+	this.group = null;
+	this.groupIndex = null;
+
 	this.recvPaused = false;
 	this.sendPaused = true;
 
@@ -50,12 +65,28 @@ function Socket (options) {
 					: 0),
 			((options && options.addressFamily)
 					? options.addressFamily
-					: AddressFamily.IPv4)
+					: AddressFamily.IPv4),
+			((options && options.engine)
+					? options.engine
+					: Engine.Poll),
+			this.buffer.length,
+			((options && options.recvErrors)
+					? true
+					: false),
+			((options && options.tun)
+					? options.tun
+					: "")
 		);
 
+	this.engine = this.wrap.engine ();
+	this.tun = this.wrap.tunName ();
+
 	var me = this;
 	this.wrap.on ("sendReady", this.onSendReady.bind (me));
 	this.wrap.on ("recvReady", this.onRecvReady.bind (me));
+	this.wrap.on ("recvBatch", this.onRecvBatch.bind (me));
+	this.wrap.on ("recvErrors", this.onRecvErrors.bind (me));
+	this.wrap.on ("scanResults", this.onScanResults.bind (me));
 	this.wrap.on ("error", this.onError.bind (me));
 	this.wrap.on ("close", this.onClose.bind (me));
 };
@@ -63,15 +94,52 @@ function Socket (options) {
 util.inherits (Socket, events.EventEmitter);
 
 Socket.prototype.close = function () {
+	this.closed = true;
+	if (this.group)
+		this.group.remove (this);
 	this.wrap.close ();
 	return this;
 }
 
+Socket.prototype.flushRequests = function () {
+	this.flushScheduled = false;
+
+	var me = this;
+
+	/**
+	 ** A before callback may change socket options for the request it belongs
+	 ** to, so a batch is cut short at each request carrying one and the
+	 ** callback is run just before that request's batch is submitted.
+	 **/
+	while (this.requests.length > 0) {
+		var batch = [this.requests.shift ()];
+		while (this.requests.length > 0 && ! this.requests[0].beforeCallback)
+			batch.push (this.requests.shift ());
+
+		try {
+			if (batch[0].beforeCallback)
+				batch[0].beforeCallback ();
+			this.wrap.sendBatch (batch, function (results) {
+				for (var i = 0; i < results.length; i++) {
+					if (results[i] instanceof Error)
+						this[i].afterCallback.call (me, results[i], 0);
+					else
+						this[i].afterCallback.call (me, null, results[i]);
+				}
+			}.bind (batch));
+		} catch (error) {
+			for (var i = 0; i < batch.length; i++)
+				batch[i].afterCallback.call (me, error, 0);
+		}
+	}
+}
+
 Socket.prototype.getOption = function (level, option, value, length) {
 	return this.wrap.getOption (level, option, value, length);
 }
 
 Socket.prototype.onClose = function () {
+	this.closed = true;
 	this.emit ("close");
 }
 
@@ -92,6 +160,22 @@ Socket.prototype.onRecvReady = function () {
 	}
 }
 
+Socket.prototype.onRecvBatch = function (buffers, sources) {
+	/**
+	 ** A message listener may close the socket part way through a batch.
+	 **/
+	for (var i = 0; i < buffers.length && ! this.closed; i++)
+		this.emit ("message", buffers[i], sources[i]);
+}
+
+Socket.prototype.onRecvErrors = function (errors) {
+	this.emit ("recvErrors", errors);
+}
+
+Socket.prototype.onScanResults = function (results) {
+	this.emit ("scanResults", results);
+}
+
 Socket.prototype.onSendReady = function () {
 	if (this.requests.length > 0) {
 		var me = this;
@@ -124,6 +208,30 @@ Socket.prototype.pauseSend = function () {
 	return this;
 }
 
+Socket.prototype.reassemblyStats = function () {
+	return this.wrap.getReassemblyStats ();
+}
+
+Socket.prototype.replay = function (path, options, callback) {
+	if (! callback) {
+		callback = options;
+		options = {};
+	}
+
+	var me = this;
+	this.wrap.replay (path,
+			((options && options.rate !== undefined)
+					? options.rate
+					: 1),
+			((options && options.address)
+					? options.address
+					: ""),
+			function (error, stats) {
+				callback.call (me, error, stats);
+			});
+	return this;
+}
+
 Socket.prototype.resumeRecv = function () {
 	this.recvPaused = false;
 	this.wrap.pause (this.recvPaused, this.sendPaused);
@@ -136,6 +244,41 @@ Socket.prototype.resumeSend = function () {
 	return this;
 }
 
+Socket.prototype.scan = function (targets, ports, options, callback) {
+	if (! callback) {
+		callback = options;
+		options = {};
+	}
+
+	/**
+	 ** Replies are matched on our port, so a random one from the usual
+	 ** ephemeral range is picked unless one is given.
+	 **/
+	var sourcePort = (options && options.sourcePort)
+			? options.sourcePort
+			: 32768 + Math.floor (Math.random () * 28232);
+
+	var me = this;
+	this.wrap.scan (targets, ports,
+			((options && options.source)
+					? options.source
+					: ""),
+			sourcePort,
+			((options && options.rate)
+					? options.rate
+					: 0),
+			((options && options.wait !== undefined)
+					? options.wait
+					: 1000),
+			((options && options.ttl)
+					? options.ttl
+					: 64),
+			function (error, stats) {
+				callback.call (me, error, stats);
+			});
+	return this;
+}
+
 Socket.prototype.send = function (buffer, offset, length, address,
 		beforeCallback, afterCallback) {
 	if (! afterCallback) {
@@ -143,14 +286,29 @@ Socket.prototype.send = function (buffer, offset, length, address,
 		beforeCallback = null;
 	}
 
-	if (length + offset > buffer.length)  {
-		afterCallback.call (this, new Error ("Buffer length '" + buffer.length
+	/**
+	 ** An array of buffers is sent as if the buffers had been concatenated.
+	 **/
+	var bufferLength = buffer.length;
+	if (Array.isArray (buffer)) {
+		bufferLength = 0;
+		for (var i = 0; i < buffer.length; i++)
+			bufferLength += buffer[i].length;
+	}
+
+	if (length + offset > bufferLength)  {
+		afterCallback.call (this, new Error ("Buffer length '" + bufferLength
 				+ "' is not large enough for the specified offset '" + offset
 				+ "' plus length '" + length + "'"));
 		return this;
 	}
 
-	if (! net.isIP (address)) {
+	/**
+	 ** Packets written to a TUN device already carry their destination.
+	 **/
+	if (this.tun) {
+		address = "";
+	} else if (! net.isIP (address)) {
 		afterCallback.call (this, new Error ("Invalid IP address '" + address + "'"));
 		return this;
 	}
@@ -165,8 +323,19 @@ Socket.prototype.send = function (buffer, offset, length, address,
 	};
 	this.requests.push (req);
 
-	if (this.sendPaused)
+	/**
+	 ** The io_uring engine does not wait for the socket to become writable,
+	 ** requests made during this turn of the event loop are submitted
+	 ** together in as few batches as possible.
+	 **/
+	if (this.engine == Engine.Uring) {
+		if (! this.flushScheduled) {
+			this.flushScheduled = true;
+			setImmediate (this.flushRequests.bind (this));
+		}
+	} else if (this.sendPaused) {
 		this.resumeSend ();
+	}
 
 	return this;
 }
@@ -178,6 +347,123 @@ Socket.prototype.setOption = function (level, option, value, length) {
 		this.wrap.setOption (level, option, value);
 }
 
+Socket.prototype.startCapture = function (path, options) {
+	this.wrap.startCapture (path,
+			((options && options.sent)
+					? true
+					: false),
+			((options && options.bufferSize)
+					? options.bufferSize
+					: 1048576)
+		);
+	return this;
+}
+
+Socket.prototype.startReassembly = function (options) {
+	this.wrap.startReassembly (
+			((options && options.memory)
+					? options.memory
+					: 4194304),
+			((options && options.timeout !== undefined)
+					? options.timeout
+					: 30000)
+		);
+	return this;
+}
+
+Socket.prototype.stopCapture = function () {
+	return this.wrap.stopCapture ();
+}
+
+Socket.prototype.stopReassembly = function () {
+	return this.wrap.stopReassembly ();
+}
+
+Socket.prototype.stopReplay = function () {
+	this.wrap.stopReplay ();
+	return this;
+}
+
+Socket.prototype.stopScan = function () {
+	this.wrap.stopScan ();
+	return this;
+}
+
+function SocketGroup (options) {
+	SocketGroup.super_.call (this);
+
+	this.sockets = [];
+	this.recvPaused = false;
+
+	this.wrap = new raw.SocketGroupWrap (
+			((options && options.bufferSize)
+					? options.bufferSize
+					: 4096)
+		);
+
+	var me = this;
+	this.wrap.on ("recvBatch", this.onRecvBatch.bind (me));
+	this.wrap.on ("error", this.onError.bind (me));
+	this.wrap.on ("close", this.onClose.bind (me));
+}
+
+util.inherits (SocketGroup, events.EventEmitter);
+
+SocketGroup.prototype.add = function (socket) {
+	var index = this.wrap.add (socket.wrap);
+	this.sockets[index] = socket;
+	socket.group = this;
+	socket.groupIndex = index;
+	return index;
+}
+
+SocketGroup.prototype.close = function () {
+	for (var i = 0; i < this.sockets.length; i++) {
+		if (this.sockets[i]) {
+			this.sockets[i].group = null;
+			this.sockets[i].groupIndex = null;
+		}
+	}
+	this.sockets = [];
+	this.wrap.close ();
+	return this;
+}
+
+SocketGroup.prototype.onClose = function () {
+	this.emit ("close");
+}
+
+SocketGroup.prototype.onError = function (error) {
+	this.emit ("error", error);
+	this.close ();
+}
+
+SocketGroup.prototype.onRecvBatch = function (indexes, buffers, sources) {
+	this.emit ("messages", indexes, buffers, sources);
+}
+
+SocketGroup.prototype.pauseRecv = function () {
+	this.recvPaused = true;
+	this.wrap.pause (this.recvPaused);
+	return this;
+}
+
+SocketGroup.prototype.remove = function (socket) {
+	if (socket.group !== this)
+		return this;
+	this.wrap.remove (socket.wrap);
+	delete this.sockets[socket.groupIndex];
+	socket.group = null;
+	socket.groupIndex = null;
+	return this;
+}
+
+SocketGroup.prototype.resumeRecv = function () {
+	this.recvPaused = false;
+	this.wrap.pause (this.recvPaused);
+	return this;
+}
+
 exports.createChecksum = function () {
 	var sum = 0;
 	for (var i = 0; i < arguments.length; i++) {
@@ -202,10 +488,18 @@ exports.createSocket = function (options) {
 	return new Socket (options || {});
 };
 
+exports.createSocketGroup = function (options) {
+	if (! raw.SocketGroupWrap)
+		throw new Error ("Socket groups are only supported on Linux");
+	return new SocketGroup (options || {});
+};
+
 exports.AddressFamily = AddressFamily;
+exports.Engine = Engine;
 exports.Protocol = Protocol;
 
 exports.Socket = Socket;
+exports.SocketGroup = SocketGroup;
 
 exports.SocketLevel = raw.SocketLevel;
 exports.SocketOption = raw.SocketOption;
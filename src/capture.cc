@@ -0,0 +1,669 @@
+#ifndef CAPTURE_CC
+#define CAPTURE_CC
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include "capture.h"
+#include "checksum.h"
+
+namespace raw {
+
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 1
+#define PCAPNG_PB 2
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_MAGIC 0x1A2B3C4D
+
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_TSRESOL 9
+#define PCAPNG_OPT_FLAGS 2
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_DLT_RAW1 12
+#define LINKTYPE_DLT_RAW2 14
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+/**
+ ** Anything claiming to be larger than this is taken to be a corrupt file
+ ** rather than something worth allocating memory for.
+ **/
+#define CAPTURE_MAX_BLOCK (16 * 1024 * 1024)
+
+#define CAPTURE_FLUSH_INTERVAL 1000000000ULL
+
+static size_t Pad4 (size_t length) {
+	return (length + 3) & ~((size_t) 3);
+}
+
+static void Put16 (char *data, uint16_t value) {
+	memcpy (data, &value, sizeof (value));
+}
+
+static void Put32 (char *data, uint32_t value) {
+	memcpy (data, &value, sizeof (value));
+}
+
+static uint16_t Get16 (const char *data) {
+	uint16_t value;
+	memcpy (&value, data, sizeof (value));
+	return value;
+}
+
+static uint32_t Get32 (const char *data) {
+	uint32_t value;
+	memcpy (&value, data, sizeof (value));
+	return value;
+}
+
+/**
+ ** Microseconds since the epoch, uv_gettimeofday() is only available from
+ ** libuv 1.28 onwards.
+ **/
+static uint64_t Now (void) {
+#if UV_VERSION_MAJOR > 1 || (UV_VERSION_MAJOR == 1 && UV_VERSION_MINOR >= 28)
+	uv_timeval64_t now;
+	uv_gettimeofday (&now);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+#elif defined(_WIN32)
+	FILETIME now;
+	GetSystemTimeAsFileTime (&now);
+	uint64_t ticks = ((uint64_t) now.dwHighDateTime << 32)
+			| now.dwLowDateTime;
+	return ticks / 10 - 11644473600000000ULL;
+#else
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+CaptureWriter::CaptureWriter () {
+	file_ = NULL;
+	running_ = false;
+	closing_ = false;
+	error_ = 0;
+	buffer_size_ = 0;
+	buffer_count_ = 0;
+	current_ = NULL;
+	memset (&stats_, 0, sizeof (stats_));
+}
+
+CaptureWriter::~CaptureWriter () {
+	this->Close ();
+}
+
+/**
+ ** Each capture file is a single section with a single interface, which is
+ ** a raw IP interface with the default microsecond timestamp resolution.
+ **/
+int CaptureWriter::Open (const char *path, size_t buffer_size,
+		unsigned int buffer_count) {
+	this->file_ = fopen (path, "wb");
+	if (! this->file_)
+		return errno;
+
+	this->buffer_size_ = buffer_size;
+	this->buffer_count_ = buffer_count;
+	this->current_ = this->TakeBuffer ();
+
+	char header[48];
+	memset (header, 0, sizeof (header));
+
+	Put32 (header, PCAPNG_SHB);
+	Put32 (header + 4, 28);
+	Put32 (header + 8, PCAPNG_MAGIC);
+	Put16 (header + 12, 1);
+	Put16 (header + 14, 0);
+	Put32 (header + 16, 0xffffffff);
+	Put32 (header + 20, 0xffffffff);
+	Put32 (header + 24, 28);
+
+	Put32 (header + 28, PCAPNG_IDB);
+	Put32 (header + 32, 20);
+	Put16 (header + 36, LINKTYPE_RAW);
+	Put32 (header + 44, 20);
+
+	this->current_->insert (this->current_->end (), header,
+			header + sizeof (header));
+
+	uv_mutex_init (&this->mutex_);
+	uv_cond_init (&this->cond_);
+
+	/**
+	 ** Put everything back as it was before, Close() and the destructor
+	 ** expect nothing to be held unless the thread is running.
+	 **/
+	if (uv_thread_create (&this->thread_, Run, this) != 0) {
+		uv_cond_destroy (&this->cond_);
+		uv_mutex_destroy (&this->mutex_);
+		fclose (this->file_);
+		this->file_ = NULL;
+		delete this->current_;
+		this->current_ = NULL;
+		this->buffer_size_ = 0;
+		this->buffer_count_ = 0;
+		return EAGAIN;
+	}
+
+	this->running_ = true;
+
+	return 0;
+}
+
+int CaptureWriter::Close (void) {
+	if (! this->running_)
+		return 0;
+
+	uv_mutex_lock (&this->mutex_);
+	if (this->current_->size ()) {
+		this->full_.push_back (this->current_);
+		this->current_ = NULL;
+	}
+	this->closing_ = true;
+	uv_cond_signal (&this->cond_);
+	uv_mutex_unlock (&this->mutex_);
+
+	uv_thread_join (&this->thread_);
+	this->running_ = false;
+
+	uv_cond_destroy (&this->cond_);
+	uv_mutex_destroy (&this->mutex_);
+
+	if (fclose (this->file_) != 0 && ! this->error_)
+		this->error_ = errno;
+	this->file_ = NULL;
+
+	delete this->current_;
+	this->current_ = NULL;
+	for (size_t i = 0; i < this->spare_.size (); i++)
+		delete this->spare_[i];
+	this->spare_.clear ();
+
+	return this->error_;
+}
+
+/**
+ ** An enhanced packet block is written for each packet, carrying the
+ ** direction in the epb_flags option.
+ **/
+void CaptureWriter::Append (int direction, int family, int protocol,
+		const struct sockaddr *source, const struct sockaddr *destination,
+		const char *data, size_t length, bool header) {
+	size_t header_length = header ? 0 : (family == AF_INET6 ? 40 : 20);
+	size_t captured = header_length + length;
+	size_t block = 28 + Pad4 (captured) + 12 + 4;
+
+	uint64_t timestamp = Now ();
+
+	uv_mutex_lock (&this->mutex_);
+
+	if (this->current_->size () + block > this->buffer_size_
+			&& this->current_->size ()) {
+		if (this->full_.size () >= this->buffer_count_) {
+			this->stats_.dropped++;
+			uv_mutex_unlock (&this->mutex_);
+			return;
+		}
+		this->full_.push_back (this->current_);
+		this->current_ = this->TakeBuffer ();
+		uv_cond_signal (&this->cond_);
+	}
+
+	size_t offset = this->current_->size ();
+	this->current_->resize (offset + block, 0);
+	char *out = &(*this->current_)[offset];
+
+	Put32 (out, PCAPNG_EPB);
+	Put32 (out + 4, (uint32_t) block);
+	Put32 (out + 8, 0);
+	Put32 (out + 12, (uint32_t) (timestamp >> 32));
+	Put32 (out + 16, (uint32_t) timestamp);
+	Put32 (out + 20, (uint32_t) captured);
+	Put32 (out + 24, (uint32_t) captured);
+
+	char *ip = out + 28;
+
+	if (header_length == 40) {
+		ip[0] = 0x60;
+		ip[4] = (char) ((length >> 8) & 0xff);
+		ip[5] = (char) (length & 0xff);
+		ip[6] = (char) protocol;
+		ip[7] = 64;
+		if (source && source->sa_family == AF_INET6)
+			memcpy (ip + 8, &((struct sockaddr_in6 *) source)->sin6_addr, 16);
+		if (destination && destination->sa_family == AF_INET6)
+			memcpy (ip + 24, &((struct sockaddr_in6 *) destination)->sin6_addr,
+					16);
+	} else if (header_length == 20) {
+		size_t total = captured > 0xffff ? 0xffff : captured;
+		ip[0] = 0x45;
+		ip[2] = (char) ((total >> 8) & 0xff);
+		ip[3] = (char) (total & 0xff);
+		ip[8] = 64;
+		ip[9] = (char) protocol;
+		if (source && source->sa_family == AF_INET)
+			memcpy (ip + 12, &((struct sockaddr_in *) source)->sin_addr, 4);
+		if (destination && destination->sa_family == AF_INET)
+			memcpy (ip + 16, &((struct sockaddr_in *) destination)->sin_addr, 4);
+		uint16_t sum = checksum (0, (unsigned char *) ip, 20);
+		ip[10] = (char) (sum >> 8);
+		ip[11] = (char) (sum & 0xff);
+	}
+
+	memcpy (ip + header_length, data, length);
+
+	char *options = out + 28 + Pad4 (captured);
+	Put16 (options, PCAPNG_OPT_FLAGS);
+	Put16 (options + 2, 4);
+	Put32 (options + 4, direction == CAPTURE_INBOUND ? 1 : 2);
+	Put32 (options + 8, PCAPNG_OPT_END);
+	Put32 (options + 12, (uint32_t) block);
+
+	this->stats_.packets++;
+	this->stats_.bytes += length;
+
+	uv_mutex_unlock (&this->mutex_);
+}
+
+void CaptureWriter::Run (void *arg) {
+	CaptureWriter *writer = (CaptureWriter *) arg;
+
+	uv_mutex_lock (&writer->mutex_);
+
+	while (true) {
+		/**
+		 ** Whatever has been buffered is also written out periodically, so
+		 ** the file is useful even when packets are arriving slowly.
+		 **/
+		while (writer->full_.empty () && ! writer->closing_) {
+			if (uv_cond_timedwait (&writer->cond_, &writer->mutex_,
+					CAPTURE_FLUSH_INTERVAL) == UV_ETIMEDOUT
+					&& writer->current_ && writer->current_->size ()) {
+				writer->full_.push_back (writer->current_);
+				writer->current_ = writer->TakeBuffer ();
+			}
+		}
+
+		if (writer->full_.empty ())
+			break;
+
+		std::vector<char> *buffer = writer->full_.front ();
+		writer->full_.pop_front ();
+
+		uv_mutex_unlock (&writer->mutex_);
+
+		if (! writer->error_) {
+			if (fwrite (&(*buffer)[0], 1, buffer->size (), writer->file_)
+					!= buffer->size () || fflush (writer->file_) != 0)
+				writer->error_ = errno ? errno : EIO;
+		}
+
+		buffer->clear ();
+
+		uv_mutex_lock (&writer->mutex_);
+		writer->spare_.push_back (buffer);
+	}
+
+	uv_mutex_unlock (&writer->mutex_);
+}
+
+void CaptureWriter::Stats (CaptureStats *stats) {
+	if (this->running_)
+		uv_mutex_lock (&this->mutex_);
+	*stats = this->stats_;
+	if (this->running_)
+		uv_mutex_unlock (&this->mutex_);
+}
+
+/**
+ ** Must be called with the mutex held once the thread is running.
+ **/
+std::vector<char> *CaptureWriter::TakeBuffer (void) {
+	std::vector<char> *buffer;
+
+	if (this->spare_.size ()) {
+		buffer = this->spare_.back ();
+		this->spare_.pop_back ();
+	} else {
+		buffer = new std::vector<char> ();
+		buffer->reserve (this->buffer_size_);
+	}
+
+	return buffer;
+}
+
+CaptureReader::CaptureReader () {
+	file_ = NULL;
+	pcapng_ = false;
+	swapped_ = false;
+	linktype_ = 0;
+	resolution_ = 1000000;
+	skipped_ = 0;
+}
+
+CaptureReader::~CaptureReader () {
+	this->Close ();
+}
+
+void CaptureReader::Close (void) {
+	if (this->file_) {
+		fclose (this->file_);
+		this->file_ = NULL;
+	}
+}
+
+/**
+ ** Only IP packets are of any use for replay, link layer headers are removed
+ ** and anything else is counted as skipped.
+ **/
+int CaptureReader::Decode (int linktype, uint64_t timestamp, size_t offset,
+		size_t length, CapturePacket *packet) {
+	const unsigned char *bytes = (const unsigned char *) &this->data_[offset];
+	size_t skip = 0;
+	int ethertype = -1;
+
+	switch (linktype) {
+		case LINKTYPE_NULL:
+		case LINKTYPE_LOOP:
+			skip = 4;
+			break;
+		case LINKTYPE_ETHERNET:
+			skip = 14;
+			if (length >= skip)
+				ethertype = (bytes[12] << 8) | bytes[13];
+			while ((ethertype == 0x8100 || ethertype == 0x88a8)
+					&& length >= skip + 4) {
+				ethertype = (bytes[skip + 2] << 8) | bytes[skip + 3];
+				skip += 4;
+			}
+			if (ethertype != 0x0800 && ethertype != 0x86dd)
+				skip = length;
+			break;
+		case LINKTYPE_DLT_RAW1:
+		case LINKTYPE_DLT_RAW2:
+		case LINKTYPE_RAW:
+		case LINKTYPE_IPV4:
+		case LINKTYPE_IPV6:
+			break;
+		case LINKTYPE_LINUX_SLL:
+			skip = 16;
+			break;
+		case LINKTYPE_LINUX_SLL2:
+			skip = 20;
+			break;
+		default:
+			skip = length;
+			break;
+	}
+
+	if (length <= skip) {
+		this->skipped_++;
+		return 1;
+	}
+
+	int version = bytes[skip] >> 4;
+	if (version != 4 && version != 6) {
+		this->skipped_++;
+		return 1;
+	}
+
+	packet->timestamp = timestamp;
+	packet->family = version == 6 ? AF_INET6 : AF_INET;
+	packet->data = (const char *) bytes + skip;
+	packet->length = length - skip;
+
+	return 0;
+}
+
+int CaptureReader::Next (CapturePacket *packet) {
+	if (! this->file_)
+		return CAPTURE_END;
+
+	return this->pcapng_ ? this->NextPcapng (packet) : this->NextPcap (packet);
+}
+
+int CaptureReader::NextPcap (CapturePacket *packet) {
+	while (true) {
+		char header[16];
+		int rc = this->Read (header, sizeof (header));
+		if (rc != 0)
+			return rc;
+
+		uint32_t seconds = this->Swap32 (Get32 (header));
+		uint32_t fraction = this->Swap32 (Get32 (header + 4));
+		uint32_t captured = this->Swap32 (Get32 (header + 8));
+
+		if (captured > CAPTURE_MAX_BLOCK)
+			return CAPTURE_EFORMAT;
+
+		this->data_.resize (captured ? captured : 1);
+		rc = this->Read (&this->data_[0], captured);
+		if (rc != 0)
+			return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+		uint64_t timestamp = (uint64_t) seconds * 1000000
+				+ (uint64_t) fraction * 1000000 / this->resolution_;
+
+		if (this->Decode (this->linktype_, timestamp, 0, captured, packet) == 0)
+			return 0;
+	}
+}
+
+int CaptureReader::NextPcapng (CapturePacket *packet) {
+	while (true) {
+		char header[8];
+		int rc = this->Read (header, sizeof (header));
+		if (rc != 0)
+			return rc;
+
+		uint32_t type = Get32 (header);
+		uint32_t length = Get32 (header + 4);
+
+		if (type == PCAPNG_SHB) {
+			rc = this->ReadSection (length);
+			if (rc != 0)
+				return rc;
+			continue;
+		}
+
+		type = this->Swap32 (type);
+		length = this->Swap32 (length);
+
+		if (length < 12 || length % 4 || length > CAPTURE_MAX_BLOCK)
+			return CAPTURE_EFORMAT;
+
+		/**
+		 ** The block body followed by the trailing copy of its length.
+		 **/
+		size_t body = length - 12;
+		this->data_.resize (body + 4);
+		rc = this->Read (&this->data_[0], body + 4);
+		if (rc != 0)
+			return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+		const char *data = &this->data_[0];
+
+		if (type == PCAPNG_IDB) {
+			if (body < 8)
+				return CAPTURE_EFORMAT;
+
+			uint64_t resolution = 1000000;
+			size_t offset = 8;
+
+			while (offset + 4 <= body) {
+				uint16_t code = this->Swap16 (Get16 (data + offset));
+				uint16_t size = this->Swap16 (Get16 (data + offset + 2));
+				if (code == PCAPNG_OPT_END || offset + 4 + size > body)
+					break;
+				if (code == PCAPNG_OPT_TSRESOL && size >= 1) {
+					unsigned char value = (unsigned char) data[offset + 4];
+					unsigned int exponent = value & 0x7f;
+					resolution = 1;
+					for (unsigned int i = 0; i < exponent && i < 63; i++)
+						resolution *= (value & 0x80) ? 2 : 10;
+				}
+				offset += 4 + Pad4 (size);
+			}
+
+			this->linktypes_.push_back (this->Swap16 (Get16 (data)));
+			this->resolutions_.push_back (resolution ? resolution : 1);
+		} else if (type == PCAPNG_EPB || type == PCAPNG_PB) {
+			if (body < 20)
+				return CAPTURE_EFORMAT;
+
+			uint32_t interface = type == PCAPNG_EPB
+					? this->Swap32 (Get32 (data))
+					: this->Swap16 (Get16 (data));
+			uint64_t stamp = ((uint64_t) this->Swap32 (Get32 (data + 4)) << 32)
+					| this->Swap32 (Get32 (data + 8));
+			uint32_t captured = this->Swap32 (Get32 (data + 12));
+
+			if (interface >= this->linktypes_.size () || 20 + captured > body)
+				return CAPTURE_EFORMAT;
+
+			uint64_t resolution = this->resolutions_[interface];
+			uint64_t timestamp = (stamp / resolution) * 1000000
+					+ (uint64_t) ((double) (stamp % resolution) * 1000000
+					/ resolution);
+
+			if (this->Decode (this->linktypes_[interface], timestamp, 20,
+					captured, packet) == 0)
+				return 0;
+		} else if (type == PCAPNG_SPB) {
+			if (body < 4 || this->linktypes_.empty ())
+				return CAPTURE_EFORMAT;
+
+			/**
+			 ** Simple packet blocks carry no timestamp, they are replayed
+			 ** as soon as they are reached.
+			 **/
+			uint32_t captured = this->Swap32 (Get32 (data));
+			if (captured > body - 4)
+				captured = (uint32_t) body - 4;
+
+			if (this->Decode (this->linktypes_[0], 0, 4, captured, packet) == 0)
+				return 0;
+		}
+	}
+}
+
+int CaptureReader::Open (const char *path) {
+	this->file_ = fopen (path, "rb");
+	if (! this->file_)
+		return errno;
+
+	char header[24];
+	int rc = this->Read (header, 4);
+	if (rc != 0)
+		return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+	uint32_t magic = Get32 (header);
+
+	if (magic == PCAPNG_SHB) {
+		this->pcapng_ = true;
+		if (fseek (this->file_, 0, SEEK_SET) != 0)
+			return errno;
+		return 0;
+	}
+
+	if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS) {
+		this->swapped_ = false;
+	} else {
+		this->swapped_ = true;
+		magic = this->Swap32 (magic);
+		if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS)
+			return CAPTURE_EFORMAT;
+	}
+
+	rc = this->Read (header + 4, 20);
+	if (rc != 0)
+		return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+	this->resolution_ = magic == PCAP_MAGIC_NS ? 1000000000 : 1000000;
+	this->linktype_ = this->Swap32 (Get32 (header + 20)) & 0xffff;
+
+	return 0;
+}
+
+/**
+ ** Returns CAPTURE_END only when the end of the file is reached before any
+ ** data was read, a partial read means the file has been truncated.
+ **/
+int CaptureReader::Read (void *data, size_t length) {
+	if (length == 0)
+		return 0;
+
+	size_t count = fread (data, 1, length, this->file_);
+	if (count == length)
+		return 0;
+
+	if (ferror (this->file_))
+		return errno ? errno : EIO;
+
+	return count == 0 ? CAPTURE_END : CAPTURE_EFORMAT;
+}
+
+/**
+ ** A new section may use a different byte order, and starts over with no
+ ** interfaces.
+ **/
+int CaptureReader::ReadSection (uint32_t length) {
+	char magic[4];
+	int rc = this->Read (magic, sizeof (magic));
+	if (rc != 0)
+		return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+	uint32_t value = Get32 (magic);
+	if (value == PCAPNG_MAGIC)
+		this->swapped_ = false;
+	else if (value == 0x4D3C2B1A)
+		this->swapped_ = true;
+	else
+		return CAPTURE_EFORMAT;
+
+	length = this->Swap32 (length);
+	if (length < 28 || length % 4 || length > CAPTURE_MAX_BLOCK)
+		return CAPTURE_EFORMAT;
+
+	this->data_.resize (length - 12);
+	rc = this->Read (&this->data_[0], length - 12);
+	if (rc != 0)
+		return rc == CAPTURE_END ? CAPTURE_EFORMAT : rc;
+
+	this->linktypes_.clear ();
+	this->resolutions_.clear ();
+
+	return 0;
+}
+
+uint16_t CaptureReader::Swap16 (uint16_t value) {
+	if (! this->swapped_)
+		return value;
+	return (uint16_t) ((value >> 8) | (value << 8));
+}
+
+uint32_t CaptureReader::Swap32 (uint32_t value) {
+	if (! this->swapped_)
+		return value;
+	return ((value >> 24) & 0xff) | ((value >> 8) & 0xff00)
+			| ((value << 8) & 0xff0000) | ((value << 24) & 0xff000000);
+}
+
+}; /* namespace raw */
+
+#endif /* CAPTURE_CC */
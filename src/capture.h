@@ -0,0 +1,141 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/**
+ ** Packet capture to pcapng files, and reading of pcap and pcapng files so
+ ** their packets can be replayed.
+ **
+ ** Packets appended to a CaptureWriter are formatted into large buffers which
+ ** a background thread writes out, so the thread receiving packets never
+ ** waits on the disk.  Like the io_uring engine these classes know nothing
+ ** about node or V8, the SocketWrap class drives them.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <Ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include <deque>
+#include <vector>
+
+#include <uv.h>
+
+namespace raw {
+
+#define CAPTURE_INBOUND 1
+#define CAPTURE_OUTBOUND 2
+
+/**
+ ** Returned by the reader in place of an error number at the end of a file,
+ ** and when a file is not in a format it understands.
+ **/
+#define CAPTURE_END -1
+#define CAPTURE_EFORMAT -2
+
+struct CaptureStats {
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t dropped;
+};
+
+class CaptureWriter {
+public:
+	CaptureWriter ();
+	~CaptureWriter ();
+
+	int Open (const char *path, size_t buffer_size, unsigned int buffer_count);
+	int Close (void);
+
+	/**
+	 ** Packets are captured as raw IP packets, when header is false the data
+	 ** does not start with an IP header and one is made up using the family,
+	 ** protocol and addresses given, either address may be NULL.
+	 **/
+	void Append (int direction, int family, int protocol,
+			const struct sockaddr *source, const struct sockaddr *destination,
+			const char *data, size_t length, bool header);
+
+	void Stats (CaptureStats *stats);
+
+private:
+	std::vector<char> *TakeBuffer (void);
+	static void Run (void *arg);
+
+	FILE *file_;
+	bool running_;
+	bool closing_;
+	int error_;
+
+	uv_thread_t thread_;
+	uv_mutex_t mutex_;
+	uv_cond_t cond_;
+
+	size_t buffer_size_;
+	unsigned int buffer_count_;
+	std::vector<char> *current_;
+	std::deque<std::vector<char> *> full_;
+	std::vector<std::vector<char> *> spare_;
+
+	CaptureStats stats_;
+};
+
+/**
+ ** Data points into the reader and stays valid until the next call to Next(),
+ ** link layer headers have already been removed so it starts with the IP
+ ** header.  The timestamp is in microseconds.
+ **/
+struct CapturePacket {
+	uint64_t timestamp;
+	int family;
+	const char *data;
+	size_t length;
+};
+
+class CaptureReader {
+public:
+	CaptureReader ();
+	~CaptureReader ();
+
+	int Open (const char *path);
+	void Close (void);
+
+	int Next (CapturePacket *packet);
+
+	uint64_t Skipped (void) { return skipped_; }
+
+private:
+	int Decode (int linktype, uint64_t timestamp, size_t offset,
+			size_t length, CapturePacket *packet);
+	int NextPcap (CapturePacket *packet);
+	int NextPcapng (CapturePacket *packet);
+	int Read (void *data, size_t length);
+	int ReadSection (uint32_t length);
+
+	uint16_t Swap16 (uint16_t value);
+	uint32_t Swap32 (uint32_t value);
+
+	FILE *file_;
+	bool pcapng_;
+	bool swapped_;
+
+	int linktype_;
+	uint64_t resolution_;
+
+	std::vector<int> linktypes_;
+	std::vector<uint64_t> resolutions_;
+
+	std::vector<char> data_;
+	uint64_t skipped_;
+};
+
+}; /* namespace raw */
+
+#endif /* CAPTURE_H */
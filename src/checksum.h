@@ -0,0 +1,38 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+/**
+ ** The checksum routine lives in its own header so it can be shared between
+ ** the addon and the native benchmark executable (see bench/checksum.cc),
+ ** neither of which should need to pull in node or nan to use it.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+static inline uint16_t checksum (uint16_t start_with, unsigned char *buffer,
+		size_t length) {
+	unsigned i;
+	uint32_t sum = start_with > 0 ? ~start_with & 0xffff : 0;
+
+	for (i = 0; i < (length & ~1U); i += 2) {
+		sum += (uint16_t) ntohs (*((uint16_t *) (buffer + i)));
+		if (sum > 0xffff)
+			sum -= 0xffff;
+	}
+	if (i < length) {
+		sum += buffer [i] << 8;
+		if (sum > 0xffff)
+			sum -= 0xffff;
+	}
+	
+	return ~sum & 0xffff;
+}
+
+#endif /* CHECKSUM_H */
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "raw.h"
+#include "checksum.h"
 
 #ifdef _WIN32
 static char errbuf[1024];
@@ -22,25 +23,6 @@ const char* raw_strerror (int code) {
 #endif
 }
 
-static uint16_t checksum (uint16_t start_with, unsigned char *buffer,
-		size_t length) {
-	unsigned i;
-	uint32_t sum = start_with > 0 ? ~start_with & 0xffff : 0;
-
-	for (i = 0; i < (length & ~1U); i += 2) {
-		sum += (uint16_t) ntohs (*((uint16_t *) (buffer + i)));
-		if (sum > 0xffff)
-			sum -= 0xffff;
-	}
-	if (i < length) {
-		sum += buffer [i] << 8;
-		if (sum > 0xffff)
-			sum -= 0xffff;
-	}
-	
-	return ~sum & 0xffff;
-}
-
 namespace raw {
 
 static Nan::Persistent<FunctionTemplate> SocketWrap_constructor;
@@ -50,6 +32,9 @@ void InitAll (Local<Object> exports) {
 	ExportFunctions (exports);
 
 	SocketWrap::Init (exports);
+#ifdef RAW_HAVE_GROUPS
+	SocketGroupWrap::Init (exports);
+#endif
 }
 
 NODE_MODULE(raw, InitAll)
@@ -228,11 +213,17 @@ void ExportConstants (Local<Object> target) {
 
 	Nan::Set(socket_option, Nan::New("IP_HDRINCL").ToLocalChecked(), Nan::New<Number>(IP_HDRINCL));
 	Nan::Set(socket_option, Nan::New("IP_OPTIONS").ToLocalChecked(), Nan::New<Number>(IP_OPTIONS));
+#ifdef RAW_HAVE_ERRQUEUE
+	Nan::Set(socket_option, Nan::New("IP_RECVERR").ToLocalChecked(), Nan::New<Number>(IP_RECVERR));
+#endif
 	Nan::Set(socket_option, Nan::New("IP_TOS").ToLocalChecked(), Nan::New<Number>(IP_TOS));
 	Nan::Set(socket_option, Nan::New("IP_TTL").ToLocalChecked(), Nan::New<Number>(IP_TTL));
 
 #ifdef _WIN32
 	Nan::Set(socket_option, Nan::New("IPV6_HDRINCL").ToLocalChecked(), Nan::New<Number>(IPV6_HDRINCL));
+#endif
+#ifdef RAW_HAVE_ERRQUEUE
+	Nan::Set(socket_option, Nan::New("IPV6_RECVERR").ToLocalChecked(), Nan::New<Number>(IPV6_RECVERR));
 #endif
 	Nan::Set(socket_option, Nan::New("IPV6_TTL").ToLocalChecked(), Nan::New<Number>(IPV6_UNICAST_HOPS));
 	Nan::Set(socket_option, Nan::New("IPV6_UNICAST_HOPS").ToLocalChecked(), Nan::New<Number>(IPV6_UNICAST_HOPS));
@@ -256,11 +247,23 @@ void SocketWrap::Init (Local<Object> exports) {
 	tpl->InstanceTemplate()->SetInternalFieldCount(1);
 
 	Nan::SetPrototypeMethod(tpl, "close", Close);
+	Nan::SetPrototypeMethod(tpl, "engine", Engine);
 	Nan::SetPrototypeMethod(tpl, "getOption", GetOption);
+	Nan::SetPrototypeMethod(tpl, "getReassemblyStats", GetReassemblyStats);
 	Nan::SetPrototypeMethod(tpl, "pause", Pause);
 	Nan::SetPrototypeMethod(tpl, "recv", Recv);
+	Nan::SetPrototypeMethod(tpl, "replay", Replay);
+	Nan::SetPrototypeMethod(tpl, "scan", Scan);
 	Nan::SetPrototypeMethod(tpl, "send", Send);
+	Nan::SetPrototypeMethod(tpl, "sendBatch", SendBatch);
 	Nan::SetPrototypeMethod(tpl, "setOption", SetOption);
+	Nan::SetPrototypeMethod(tpl, "startCapture", StartCapture);
+	Nan::SetPrototypeMethod(tpl, "startReassembly", StartReassembly);
+	Nan::SetPrototypeMethod(tpl, "stopCapture", StopCapture);
+	Nan::SetPrototypeMethod(tpl, "stopReassembly", StopReassembly);
+	Nan::SetPrototypeMethod(tpl, "stopReplay", StopReplay);
+	Nan::SetPrototypeMethod(tpl, "stopScan", StopScan);
+	Nan::SetPrototypeMethod(tpl, "tunName", TunName);
 
 	SocketWrap_constructor.Reset(tpl);
 	Nan::Set(exports, Nan::New("SocketWrap").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
@@ -268,6 +271,24 @@ void SocketWrap::Init (Local<Object> exports) {
 
 SocketWrap::SocketWrap () {
 	deconstructing_ = false;
+	recv_errors_ = false;
+	header_included_ = false;
+	tun_ = false;
+	events_ = UV_READABLE;
+	group_ = NULL;
+	group_index_ = 0;
+	capture_ = NULL;
+	capture_sent_ = false;
+	replay_ = NULL;
+	scan_ = NULL;
+	reassembler_ = NULL;
+	reassembly_timer_ = NULL;
+#ifdef RAW_HAVE_URING
+	uring_ = NULL;
+	uring_recv_ = false;
+	uring_polling_ = false;
+	uring_in_flight_ = 0;
+#endif
 }
 
 SocketWrap::~SocketWrap () {
@@ -275,6 +296,51 @@ SocketWrap::~SocketWrap () {
 	this->CloseSocket ();
 }
 
+void SocketWrap::CaptureIn (const char *data, size_t length,
+		const struct sockaddr *source) {
+	/**
+	 ** IPv4 raw sockets receive the IP header along with the data, IPv6 raw
+	 ** sockets do not so one is made up for the capture file.
+	 **/
+	this->capture_->Append (CAPTURE_INBOUND, this->family_, this->protocol_,
+			source, NULL, data, length, this->family_ == AF_INET || this->tun_);
+}
+
+void SocketWrap::CaptureOut (const char *data, size_t length,
+		const struct sockaddr *destination) {
+	if (! this->capture_sent_)
+		return;
+
+	bool header = this->tun_ || (this->family_ == AF_INET
+			&& (this->header_included_ || this->protocol_ == IPPROTO_RAW));
+
+	this->capture_->Append (CAPTURE_OUTBOUND, this->family_, this->protocol_,
+			NULL, destination, data, length, header);
+}
+
+/**
+ ** Segments are only ever joined together for the capture file.
+ **/
+void SocketWrap::CaptureSegments (const std::vector<SOCKET_IOV_TYPE> &iov,
+		const struct sockaddr *destination) {
+	if (! this->capture_sent_)
+		return;
+
+	if (iov.size () == 1) {
+		this->CaptureOut ((const char *) SOCKET_IOV_BASE(iov[0]),
+				SOCKET_IOV_LEN(iov[0]), destination);
+		return;
+	}
+
+	std::vector<char> data;
+	for (size_t i = 0; i < iov.size (); i++) {
+		const char *base = (const char *) SOCKET_IOV_BASE(iov[i]);
+		data.insert (data.end (), base, base + SOCKET_IOV_LEN(iov[i]));
+	}
+
+	this->CaptureOut (data.size () ? &data[0] : "", data.size (), destination);
+}
+
 NAN_METHOD(SocketWrap::Close) {
 	Nan::HandleScope scope;
 	
@@ -291,8 +357,38 @@ NAN_METHOD(SocketWrap::Close) {
 }
 
 void SocketWrap::CloseSocket (void) {
+	if (this->replay_)
+		this->FinishReplay (ECANCELED);
+
+	if (this->scan_)
+		this->FinishScan (ECANCELED);
+
+	if (this->capture_) {
+		this->capture_->Close ();
+		delete this->capture_;
+		this->capture_ = NULL;
+	}
+
+	if (this->reassembler_) {
+		delete this->reassembler_;
+		this->reassembler_ = NULL;
+	}
+
+	if (this->reassembly_timer_) {
+		uv_close ((uv_handle_t *) this->reassembly_timer_, OnClose);
+		this->reassembly_timer_ = NULL;
+	}
+
+#ifdef RAW_HAVE_GROUPS
+	if (this->group_)
+		this->group_->RemoveSocket (this);
+#endif
+
 	if (this->poll_initialised_) {
 		uv_close ((uv_handle_t *) this->poll_watcher_, OnClose);
+#ifdef RAW_HAVE_URING
+		this->CloseUring ();
+#endif
 		closesocket (this->poll_fd_);
 		this->poll_fd_ = INVALID_SOCKET;
 		this->poll_initialised_ = false;
@@ -303,7 +399,38 @@ int SocketWrap::CreateSocket (void) {
 	if (this->poll_initialised_)
 		return 0;
 	
+#ifdef RAW_HAVE_TUN
+	/**
+	 ** Each descriptor opened on a multi queue TUN device attaches another
+	 ** queue, the device is created when the first queue is attached unless
+	 ** it already exists.  The kernel fills in the name when a pattern such
+	 ** as "tun%d" was given.
+	 **/
+	if (this->tun_) {
+		struct ifreq request;
+
+		this->poll_fd_ = open ("/dev/net/tun", O_RDWR | O_CLOEXEC);
+		if (this->poll_fd_ == INVALID_SOCKET)
+			return errno;
+
+		memset (&request, 0, sizeof (request));
+		request.ifr_flags = IFF_TUN | IFF_NO_PI | IFF_MULTI_QUEUE;
+		strncpy (request.ifr_name, this->tun_name_.c_str (), IFNAMSIZ - 1);
+
+		if (ioctl (this->poll_fd_, TUNSETIFF, &request) != 0) {
+			int error = errno;
+			close (this->poll_fd_);
+			this->poll_fd_ = INVALID_SOCKET;
+			return error;
+		}
+
+		this->tun_name_ = request.ifr_name;
+	} else {
+		this->poll_fd_ = socket (this->family_, SOCK_RAW, this->protocol_);
+	}
+#else
 	this->poll_fd_ = socket (this->family_, SOCK_RAW, this->protocol_);
+#endif
 	
 #ifdef __APPLE__
 	/**
@@ -335,10 +462,26 @@ int SocketWrap::CreateSocket (void) {
 		return SOCKET_ERRNO;
 #endif
 
+#ifdef RAW_HAVE_URING
+	/**
+	 ** When io_uring is requested but cannot be set up, e.g. the kernel is too
+	 ** old or io_uring has been disabled, quietly fall back to polling.  The
+	 ** engine is built on socket messages, so TUN devices are always polled.
+	 **/
+	if (this->engine_ == ENGINE_URING) {
+		if (! this->tun_ && this->CreateUring () == 0)
+			return 0;
+		this->engine_ = ENGINE_POLL;
+	}
+#else
+	this->engine_ = ENGINE_POLL;
+#endif
+
 	poll_watcher_ = new uv_poll_t;
 	uv_poll_init_socket (uv_default_loop (), this->poll_watcher_,
 			this->poll_fd_);
 	this->poll_watcher_->data = this;
+	this->events_ = UV_READABLE;
 	uv_poll_start (this->poll_watcher_, UV_READABLE, IoEvent);
 	
 	this->poll_initialised_ = true;
@@ -346,6 +489,573 @@ int SocketWrap::CreateSocket (void) {
 	return 0;
 }
 
+/**
+ ** Batched sends report one result per request, either the number of bytes
+ ** sent or an Error, a negative value in results being an error number.
+ **/
+static Local<Array> SendResults (const std::vector<int> &results) {
+	Local<Array> array = Nan::New<Array>();
+
+	for (size_t i = 0; i < results.size (); i++) {
+		Nan::Set(array, (uint32_t) i, results[i] < 0
+				? Nan::Error(raw_strerror (-results[i]))
+				: (Local<Value>) Nan::New<Number>(results[i]));
+	}
+
+	return array;
+}
+
+static int ParseAddress (uint32_t family, Local<Value> value,
+		struct sockaddr_storage *address, SOCKET_LEN_TYPE *length);
+
+static void AddSegment (std::vector<SOCKET_IOV_TYPE> *iov, char *data,
+		size_t length) {
+	SOCKET_IOV_TYPE segment;
+	SOCKET_IOV_BASE(segment) = data;
+	SOCKET_IOV_LEN(segment) = length;
+	iov->push_back (segment);
+}
+
+/**
+ ** Data to send is either a single buffer or an array of buffers which are
+ ** sent as if they had been concatenated, without copying them.  Offset and
+ ** length select a range of that data, and an iovec entry is added for each
+ ** part of a buffer within the range.  Throws and returns false if the value
+ ** is not valid.
+ **/
+static bool ParseSegments (Local<Value> value, uint32_t offset,
+		uint32_t length, std::vector<SOCKET_IOV_TYPE> *iov) {
+	iov->clear ();
+
+	if (node::Buffer::HasInstance (value)) {
+		if ((uint64_t) offset + length > node::Buffer::Length (value)) {
+			Nan::ThrowRangeError("Offset plus length exceeds the buffer length");
+			return false;
+		}
+		AddSegment (iov, node::Buffer::Data (value) + offset, length);
+		return true;
+	}
+
+	if (! value->IsArray ()) {
+		Nan::ThrowTypeError("Buffer argument must be a node Buffer object or an array of node Buffer objects");
+		return false;
+	}
+
+	Local<Array> segments = Local<Array>::Cast (value);
+	size_t skip = offset;
+	size_t remaining = length;
+
+	for (uint32_t i = 0; i < segments->Length (); i++) {
+		Local<Value> segment = Nan::Get(segments, i).ToLocalChecked();
+		if (! node::Buffer::HasInstance (segment)) {
+			Nan::ThrowTypeError("Each segment must be a node Buffer object");
+			return false;
+		}
+
+		char *data = node::Buffer::Data (segment);
+		size_t size = node::Buffer::Length (segment);
+
+		if (skip >= size) {
+			skip -= size;
+			continue;
+		}
+
+		data += skip;
+		size -= skip;
+		skip = 0;
+
+		if (size > remaining)
+			size = remaining;
+		if (size > 0)
+			AddSegment (iov, data, size);
+		remaining -= size;
+	}
+
+	if (skip > 0 || remaining > 0) {
+		Nan::ThrowRangeError("Offset plus length exceeds the buffer length");
+		return false;
+	}
+
+	return true;
+}
+
+#ifdef RAW_HAVE_URING
+#define URING_ENTRIES 256
+#define URING_BUFFERS 256
+#define URING_HARVEST 256
+#define URING_HARVEST_LIMIT 4096
+
+int SocketWrap::CreateUring (void) {
+	UringEngine *uring = new UringEngine ();
+
+	int rc = uring->Open (this->poll_fd_, URING_ENTRIES, URING_BUFFERS,
+			this->buffer_size_);
+	if (rc == 0)
+		rc = uring->StartRecv ();
+	if (rc != 0) {
+		delete uring;
+		return rc;
+	}
+
+	this->uring_ = uring;
+	this->uring_recv_ = true;
+
+	/**
+	 ** The loop watches the rings file descriptor, which becomes readable
+	 ** whenever completions are waiting, instead of the socket itself.
+	 **/
+	poll_watcher_ = new uv_poll_t;
+	uv_poll_init (uv_default_loop (), this->poll_watcher_,
+			uring->RingFd ());
+	this->poll_watcher_->data = this;
+	uv_poll_start (this->poll_watcher_, UV_READABLE, IoEvent);
+	this->uring_polling_ = true;
+
+	this->poll_initialised_ = true;
+
+	return 0;
+}
+
+void SocketWrap::CloseUring (void) {
+	if (! this->uring_)
+		return;
+
+	/**
+	 ** Sends still in flight are cancelled, and their callbacks dropped in
+	 ** the same way queued requests are on close.  Their messages can only
+	 ** be freed once the kernel has finished with them, if that cannot be
+	 ** confirmed they, and the buffers they reference, are leaked instead.
+	 **/
+	bool idle = this->uring_->Cancel ();
+
+	delete this->uring_;
+	this->uring_ = NULL;
+
+	for (size_t i = 0; i < this->uring_sends_.size (); i++) {
+		UringSend *send = this->uring_sends_[i];
+		if (send->batch && --send->batch->remaining == 0)
+			delete send->batch;
+		if (idle) {
+			send->buffer.Reset ();
+			delete send;
+		}
+	}
+
+	this->uring_sends_.clear ();
+	this->uring_free_.clear ();
+	this->uring_in_flight_ = 0;
+	this->uring_recv_ = false;
+	this->uring_polling_ = false;
+}
+
+void SocketWrap::HandleUringEvent (void) {
+	Nan::HandleScope scope;
+
+	UringCompletion completions[URING_HARVEST];
+	std::vector<UringBatch *> finished;
+	Local<Array> buffers = Nan::New<Array>();
+	Local<Array> sources = Nan::New<Array>();
+	unsigned int received = 0;
+	unsigned int harvested = 0;
+	unsigned int count;
+	bool recv_failed = false;
+	char addr[50];
+
+	/**
+	 ** Drain completions in bounded chunks so one busy socket cannot starve
+	 ** the rest of the loop, anything left keeps the ring readable and is
+	 ** picked up on the next iteration.
+	 **/
+	do {
+		count = this->uring_->Harvest (completions, URING_HARVEST);
+
+		for (unsigned int i = 0; i < count; i++) {
+			UringCompletion *completion = &completions[i];
+
+			if (completion->type == URING_RECV) {
+				if (completion->result < 0
+						&& completion->result != -ENOBUFS
+						&& completion->result != -ECANCELED)
+					recv_failed = true;
+
+				if (completion->result < 0 || ! completion->data)
+					continue;
+
+				/**
+				 ** The provided buffer was too small for the datagram, a
+				 ** partial packet is of no use so it is dropped.
+				 **/
+				if (completion->truncated)
+					continue;
+
+				if (completion->name
+						&& completion->name->sa_family == AF_INET6)
+					uv_ip6_name ((sockaddr_in6 *) completion->name, addr, 50);
+				else if (completion->name)
+					uv_ip4_name ((sockaddr_in *) completion->name, addr, 50);
+				else
+					addr[0] = '\0';
+
+				if (this->capture_)
+					this->CaptureIn (completion->data, completion->length,
+							completion->name);
+
+				const char *datagram;
+				size_t datagram_length;
+
+				if (! this->Reassemble (completion->data, completion->length,
+						&datagram, &datagram_length)
+						|| this->ScanReply (datagram, datagram_length,
+								completion->name))
+					continue;
+
+				Nan::Set(buffers, received, Nan::CopyBuffer(datagram,
+						(uint32_t) datagram_length).ToLocalChecked());
+				Nan::Set(sources, received, Nan::New(addr).ToLocalChecked());
+				received++;
+			} else if (completion->type == URING_SEND) {
+				uint32_t slot = (uint32_t) completion->user_data;
+				UringSend *send = this->uring_sends_[slot];
+
+				send->batch->results[send->index] = completion->result;
+				if (--send->batch->remaining == 0)
+					finished.push_back (send->batch);
+
+				send->batch = NULL;
+				send->buffer.Reset ();
+				this->uring_free_.push_back (slot);
+				this->uring_in_flight_--;
+			}
+		}
+
+		this->uring_->Release ();
+		harvested += count;
+	} while (count == URING_HARVEST && harvested < URING_HARVEST_LIMIT);
+
+#ifdef RAW_HAVE_ERRQUEUE
+	/**
+	 ** A queued ICMP error fails the multishot receive, which Release() has
+	 ** already re-armed, the error itself is waiting on the error queue.
+	 **/
+	Local<Array> errors = Nan::New<Array>();
+	uint32_t error_count = 0;
+
+	if (recv_failed && this->recv_errors_)
+		this->ReadErrors (errors, &error_count);
+#endif
+
+	this->UpdateUringPoll ();
+
+	/**
+	 ** Emitting may lead to the socket being closed, so the engine must not
+	 ** be touched from here on.
+	 **/
+	if (received) {
+		Local<Value> args[3];
+		args[0] = Nan::New<String>("recvBatch").ToLocalChecked();
+		args[1] = buffers;
+		args[2] = sources;
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 3, args);
+	}
+
+#ifdef RAW_HAVE_ERRQUEUE
+	if (error_count)
+		this->EmitErrors (errors);
+#endif
+
+	for (size_t i = 0; i < finished.size (); i++) {
+		UringBatch *batch = finished[i];
+
+		Local<Value> argv[1];
+		argv[0] = SendResults (batch->results);
+		Nan::Call(batch->callback, 1, argv);
+
+		delete batch;
+	}
+}
+
+void SocketWrap::UpdateUringPoll (void) {
+	/**
+	 ** The ring only needs watching while receives are wanted or sends are
+	 ** outstanding, otherwise it should not keep the event loop alive.
+	 **/
+	bool poll = this->uring_recv_ || this->uring_in_flight_ > 0;
+
+	if (poll == this->uring_polling_ || this->deconstructing_
+			|| ! this->poll_initialised_)
+		return;
+
+	if (poll)
+		uv_poll_start (this->poll_watcher_, UV_READABLE, IoEvent);
+	else
+		uv_poll_stop (this->poll_watcher_);
+
+	this->uring_polling_ = poll;
+}
+#endif
+
+#ifdef RAW_HAVE_ERRQUEUE
+#define ERRQUEUE_BUDGET 64
+
+static const char *ErrorOrigin (uint8_t origin) {
+	switch (origin) {
+		case SO_EE_ORIGIN_LOCAL:
+			return "local";
+		case SO_EE_ORIGIN_ICMP:
+			return "icmp";
+		case SO_EE_ORIGIN_ICMP6:
+			return "icmp6";
+		default:
+			return "unknown";
+	}
+}
+
+static Local<Value> ErrorAddress (const struct sockaddr *address) {
+	char addr[50];
+
+	if (address->sa_family == AF_INET6)
+		uv_ip6_name ((sockaddr_in6 *) address, addr, 50);
+	else if (address->sa_family == AF_INET)
+		uv_ip4_name ((sockaddr_in *) address, addr, 50);
+	else
+		return Nan::Null();
+
+	return Nan::New(addr).ToLocalChecked();
+}
+
+void SocketWrap::EmitErrors (Local<Array> errors) {
+	Local<Value> args[2];
+	args[0] = Nan::New<String>("recvErrors").ToLocalChecked();
+	args[1] = errors;
+
+	Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 2, args);
+}
+
+/**
+ ** Reads whatever is waiting on the sockets error queue, up to a fixed
+ ** budget, appending one object per error to errors.  Anything beyond the
+ ** budget keeps the socket in an error state and is read on the next pass.
+ **/
+int SocketWrap::ReadErrors (Local<Array> errors, uint32_t *count) {
+	std::vector<char> data (this->buffer_size_ ? this->buffer_size_ : 1);
+	char control[512];
+
+	for (unsigned int i = 0; i < ERRQUEUE_BUDGET; i++) {
+		struct sockaddr_storage name;
+		struct iovec iov;
+		struct msghdr message;
+
+		memset (&name, 0, sizeof (name));
+		memset (&message, 0, sizeof (message));
+		iov.iov_base = &data[0];
+		iov.iov_len = data.size ();
+		message.msg_name = &name;
+		message.msg_namelen = sizeof (name);
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof (control);
+
+		int rc = recvmsg (this->poll_fd_, &message, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (rc == SOCKET_ERROR) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return errno;
+		}
+
+		struct sock_extended_err *ee = NULL;
+		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR (&message); cmsg;
+				cmsg = CMSG_NXTHDR (&message, cmsg)) {
+			if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+					|| (cmsg->cmsg_level == SOL_IPV6
+					&& cmsg->cmsg_type == IPV6_RECVERR))
+				ee = (struct sock_extended_err *) CMSG_DATA (cmsg);
+		}
+
+		if (! ee)
+			continue;
+
+		Local<Object> error = Nan::New<Object>();
+		Nan::Set(error, Nan::New("error").ToLocalChecked(),
+				Nan::Error(raw_strerror (ee->ee_errno)));
+		Nan::Set(error, Nan::New("origin").ToLocalChecked(),
+				Nan::New(ErrorOrigin (ee->ee_origin)).ToLocalChecked());
+		Nan::Set(error, Nan::New("type").ToLocalChecked(),
+				Nan::New<Uint32>(ee->ee_type));
+		Nan::Set(error, Nan::New("code").ToLocalChecked(),
+				Nan::New<Uint32>(ee->ee_code));
+		Nan::Set(error, Nan::New("info").ToLocalChecked(),
+				Nan::New<Uint32>(ee->ee_info));
+		Nan::Set(error, Nan::New("offender").ToLocalChecked(),
+				ErrorAddress (SO_EE_OFFENDER (ee)));
+		Nan::Set(error, Nan::New("destination").ToLocalChecked(),
+				ErrorAddress ((struct sockaddr *) &name));
+		Nan::Set(error, Nan::New("buffer").ToLocalChecked(),
+				Nan::CopyBuffer(&data[0], (uint32_t) rc).ToLocalChecked());
+
+		Nan::Set(errors, (*count)++, error);
+	}
+
+	return 0;
+}
+
+int SocketWrap::SetRecvErrors (bool enable) {
+	int value = enable ? 1 : 0;
+	int rc;
+
+	if (this->family_ == AF_INET6)
+		rc = setsockopt (this->poll_fd_, SOL_IPV6, IPV6_RECVERR, &value,
+				sizeof (value));
+	else
+		rc = setsockopt (this->poll_fd_, SOL_IP, IP_RECVERR, &value,
+				sizeof (value));
+
+	if (rc == SOCKET_ERROR)
+		return errno;
+
+	this->recv_errors_ = enable;
+
+	return 0;
+}
+#endif
+
+/**
+ ** The results are cleared before they are emitted, since the event handler
+ ** may cause more to be collected.
+ **/
+void SocketWrap::EmitScanResults (std::vector<ScanResult> &results) {
+	Nan::HandleScope scope;
+
+	Local<Array> array = Nan::New<Array>();
+	char addr[50];
+
+	for (size_t i = 0; i < results.size (); i++) {
+		Local<Object> result = Nan::New<Object>();
+
+		if (results[i].address.ss_family == AF_INET6)
+			uv_ip6_name ((struct sockaddr_in6 *) &results[i].address, addr, 50);
+		else
+			uv_ip4_name ((struct sockaddr_in *) &results[i].address, addr, 50);
+
+		Nan::Set(result, Nan::New("address").ToLocalChecked(),
+				Nan::New(addr).ToLocalChecked());
+		Nan::Set(result, Nan::New("port").ToLocalChecked(),
+				Nan::New<Uint32>(results[i].port));
+		Nan::Set(result, Nan::New("state").ToLocalChecked(),
+				Nan::New(results[i].open ? "open" : "closed").ToLocalChecked());
+
+		Nan::Set(array, (uint32_t) i, result);
+	}
+
+	results.clear ();
+
+	Local<Value> args[2];
+	args[0] = Nan::New<String>("scanResults").ToLocalChecked();
+	args[1] = array;
+
+	Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 2, args);
+}
+
+NAN_METHOD(SocketWrap::Engine) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+
+	info.GetReturnValue().Set(Nan::New<Uint32>(socket->engine_));
+}
+
+void SocketWrap::FinishReplay (int rc) {
+	ReplayState *replay = this->replay_;
+	this->replay_ = NULL;
+
+	uv_timer_stop (replay->timer);
+	uv_close ((uv_handle_t *) replay->timer, OnClose);
+	replay->reader.Close ();
+
+	if (! this->deconstructing_) {
+		Nan::HandleScope scope;
+
+		Local<Object> stats = Nan::New<Object>();
+		Nan::Set(stats, Nan::New("packets").ToLocalChecked(),
+				Nan::New<Number>((double) replay->packets));
+		Nan::Set(stats, Nan::New("bytes").ToLocalChecked(),
+				Nan::New<Number>((double) replay->bytes));
+		Nan::Set(stats, Nan::New("skipped").ToLocalChecked(),
+				Nan::New<Number>((double) (replay->skipped
+				+ replay->reader.Skipped ())));
+		Nan::Set(stats, Nan::New("errors").ToLocalChecked(),
+				Nan::New<Number>((double) replay->errors));
+
+		Local<Value> argv[2];
+		if (rc == 0)
+			argv[0] = Nan::Null();
+		else if (rc == CAPTURE_EFORMAT)
+			argv[0] = Nan::Error("Unsupported or corrupt capture file");
+		else
+			argv[0] = Nan::Error(raw_strerror (rc));
+		argv[1] = stats;
+
+		Nan::Call(replay->callback, 2, argv);
+	}
+
+	delete replay;
+}
+
+void SocketWrap::FinishScan (int rc) {
+	ScanState *scan = this->scan_;
+	this->scan_ = NULL;
+
+	uv_timer_stop (scan->timer);
+	uv_close ((uv_handle_t *) scan->timer, OnClose);
+
+	/**
+	 ** Put back the socket options the scan changed.
+	 **/
+	if (scan->restore && this->poll_initialised_) {
+		if (this->family_ == AF_INET6) {
+			setsockopt (this->poll_fd_, IPPROTO_IPV6, IPV6_CHECKSUM,
+					(SOCKET_OPT_TYPE) &scan->checksum_offset,
+					sizeof (scan->checksum_offset));
+		} else {
+			int include = 0;
+			setsockopt (this->poll_fd_, IPPROTO_IP, IP_HDRINCL,
+					(SOCKET_OPT_TYPE) &include, sizeof (include));
+			this->header_included_ = false;
+		}
+	}
+
+	if (! this->deconstructing_) {
+		Nan::HandleScope scope;
+
+		if (scan->results.size ())
+			this->EmitScanResults (scan->results);
+
+		Local<Object> stats = Nan::New<Object>();
+		Nan::Set(stats, Nan::New("sent").ToLocalChecked(),
+				Nan::New<Number>((double) scan->sent));
+		Nan::Set(stats, Nan::New("errors").ToLocalChecked(),
+				Nan::New<Number>((double) scan->errors));
+		Nan::Set(stats, Nan::New("open").ToLocalChecked(),
+				Nan::New<Number>((double) scan->open));
+		Nan::Set(stats, Nan::New("closed").ToLocalChecked(),
+				Nan::New<Number>((double) scan->closed));
+		Nan::Set(stats, Nan::New("invalid").ToLocalChecked(),
+				Nan::New<Number>((double) scan->scanner.Invalid ()));
+
+		Local<Value> argv[2];
+		if (rc == 0)
+			argv[0] = Nan::Null();
+		else
+			argv[0] = Nan::Error(raw_strerror (rc));
+		argv[1] = stats;
+
+		Nan::Call(scan->callback, 2, argv);
+	}
+
+	delete scan;
+}
+
 NAN_METHOD(SocketWrap::GetOption) {
 	Nan::HandleScope scope;
 	
@@ -400,10 +1110,74 @@ NAN_METHOD(SocketWrap::GetOption) {
 	info.GetReturnValue().Set(got);
 }
 
+static Local<Object> ReassemblyObject (const ReassemblyStats &stats) {
+	Local<Object> object = Nan::New<Object>();
+
+	Nan::Set(object, Nan::New("fragments").ToLocalChecked(),
+			Nan::New<Number>((double) stats.fragments));
+	Nan::Set(object, Nan::New("datagrams").ToLocalChecked(),
+			Nan::New<Number>((double) stats.datagrams));
+	Nan::Set(object, Nan::New("pending").ToLocalChecked(),
+			Nan::New<Number>((double) stats.pending));
+	Nan::Set(object, Nan::New("memory").ToLocalChecked(),
+			Nan::New<Number>((double) stats.memory));
+	Nan::Set(object, Nan::New("timeouts").ToLocalChecked(),
+			Nan::New<Number>((double) stats.timeouts));
+	Nan::Set(object, Nan::New("evictions").ToLocalChecked(),
+			Nan::New<Number>((double) stats.evictions));
+	Nan::Set(object, Nan::New("overlaps").ToLocalChecked(),
+			Nan::New<Number>((double) stats.overlaps));
+	Nan::Set(object, Nan::New("invalid").ToLocalChecked(),
+			Nan::New<Number>((double) stats.invalid));
+
+	return object;
+}
+
+NAN_METHOD(SocketWrap::GetReassemblyStats) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	ReassemblyStats stats;
+
+	if (! socket->reassembler_) {
+		info.GetReturnValue().Set(Nan::Null());
+		return;
+	}
+
+	socket->reassembler_->Stats (&stats);
+
+	info.GetReturnValue().Set(ReassemblyObject (stats));
+}
+
 void SocketWrap::HandleIOEvent (int status, int revents) {
 	Nan::HandleScope scope;
 
 	if (status) {
+#ifdef RAW_HAVE_ERRQUEUE
+		/**
+		 ** libuv reports POLLERR as an error and stops the handle, which is
+		 ** also how the kernel signals queued ICMP errors once IP_RECVERR is
+		 ** enabled.  Drain the error queue and carry on in that case, only
+		 ** when there is nothing pending is the socket treated as failed.
+		 **/
+		if (this->recv_errors_ && this->engine_ == ENGINE_POLL) {
+			Local<Array> errors = Nan::New<Array>();
+			uint32_t count = 0;
+			int pending = 0;
+			socklen_t length = sizeof (pending);
+
+			if (this->ReadErrors (errors, &count) == 0
+					&& getsockopt (this->poll_fd_, SOL_SOCKET, SO_ERROR,
+							&pending, &length) == 0
+					&& (count || pending)) {
+				this->UpdatePoll ();
+				if (count)
+					this->EmitErrors (errors);
+				return;
+			}
+		}
+#endif
+
 		Local<Value> args[2];
 		args[0] = Nan::New<String>("error").ToLocalChecked();
 		
@@ -417,7 +1191,13 @@ void SocketWrap::HandleIOEvent (int status, int revents) {
 		sprintf(status_str, "%d", status);
 		args[1] = Nan::Error(status_str);
 
-		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 1, args);
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 2, args);
+#ifdef RAW_HAVE_URING
+	} else if (this->uring_) {
+		this->HandleUringEvent ();
+#endif
+	} else if (this->scan_ && (revents & UV_READABLE)) {
+		this->HandleScanRecv ();
 	} else {
 		Local<Value> args[1];
 		if (revents & UV_READABLE)
@@ -429,35 +1209,384 @@ void SocketWrap::HandleIOEvent (int status, int revents) {
 	}
 }
 
-NAN_METHOD(SocketWrap::New) {
-	Nan::HandleScope scope;
-	
-	SocketWrap* socket = new SocketWrap ();
-	int rc, family = AF_INET;
-	
-	if (info.Length () < 1) {
-		Nan::ThrowError("One argument is required");
-		return;
-	}
-	
-	if (! info[0]->IsUint32 ()) {
-		Nan::ThrowTypeError("Protocol argument must be an unsigned integer");
+/**
+ ** Datagrams are expired as fragments arrive, the timer only runs while some
+ ** are pending so they are also expired when no more fragments arrive.
+ **/
+void SocketWrap::HandleReassembly (void) {
+	if (! this->reassembler_) {
+		uv_timer_stop (this->reassembly_timer_);
 		return;
-	} else {
-		socket->protocol_ = Nan::To<Uint32>(info[0]).ToLocalChecked()->Value();
 	}
 
-	if (info.Length () > 1) {
-		if (! info[1]->IsUint32 ()) {
-			Nan::ThrowTypeError("Address family argument must be an unsigned integer");
-			return;
-		} else {
-			if (Nan::To<Uint32>(info[1]).ToLocalChecked()->Value() == 2)
-				family = AF_INET6;
-		}
+	this->reassembler_->Expire (uv_now (uv_default_loop ()));
+
+	if (this->reassembler_->Pending () == 0)
+		uv_timer_stop (this->reassembly_timer_);
+}
+
+#define REPLAY_BUDGET 1024
+
+/**
+ ** Sends every packet which is due, up to a fixed budget per event loop
+ ** iteration, then sleeps until the next one is due.  Timers have a one
+ ** millisecond resolution so packets closer together are sent in bursts.
+ **/
+void SocketWrap::HandleReplay (void) {
+	ReplayState *replay = this->replay_;
+	CapturePacket *packet = &replay->packet;
+	unsigned int count = 0;
+	int rc;
+
+	while (count++ < REPLAY_BUDGET) {
+		if (! replay->pending) {
+			rc = replay->reader.Next (packet);
+			if (rc != 0) {
+				this->FinishReplay (rc == CAPTURE_END ? 0 : rc);
+				return;
+			}
+
+			if (! replay->started) {
+				replay->base = packet->timestamp;
+				replay->start = uv_hrtime ();
+				replay->started = true;
+			}
+
+			replay->pending = true;
+		}
+
+		if (replay->rate > 0) {
+			uint64_t offset = packet->timestamp > replay->base
+					? packet->timestamp - replay->base
+					: 0;
+			uint64_t due = (uint64_t) (offset / replay->rate);
+			uint64_t now = (uv_hrtime () - replay->start) / 1000;
+
+			if (due > now) {
+				uv_timer_start (replay->timer, ReplayEvent,
+						(due - now + 999) / 1000, 0);
+				return;
+			}
+		}
+
+		/**
+		 ** Packets are sent to their original destination unless an address
+		 ** was given, and without their IP header unless the socket is
+		 ** expecting one.  A TUN device takes packets of either family and
+		 ** always as they are.
+		 **/
+		const char *data = packet->data;
+		size_t length = packet->length;
+		struct sockaddr_storage address;
+		SOCKET_LEN_TYPE address_length;
+		size_t header_length;
+
+		memset (&address, 0, sizeof (address));
+
+		if (packet->family != (int) this->family_ && ! this->tun_) {
+			replay->pending = false;
+			replay->skipped++;
+			continue;
+		}
+
+		if (packet->family == AF_INET6) {
+			header_length = 40;
+			if (length >= header_length) {
+				struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &address;
+				sin6->sin6_family = AF_INET6;
+				memcpy (&sin6->sin6_addr, data + 24, 16);
+			}
+			address_length = sizeof (struct sockaddr_in6);
+		} else {
+			header_length = (data[0] & 0x0f) * 4;
+			if (header_length >= 20 && length >= header_length) {
+				struct sockaddr_in *sin = (struct sockaddr_in *) &address;
+				sin->sin_family = AF_INET;
+				memcpy (&sin->sin_addr, data + 16, 4);
+			}
+			address_length = sizeof (struct sockaddr_in);
+		}
+
+		replay->pending = false;
+
+		if (length < header_length || header_length < 20) {
+			replay->errors++;
+			continue;
+		}
+
+		if (replay->override) {
+			address = replay->address;
+			address_length = replay->address_length;
+		}
+
+		if (! this->tun_ && ! (this->family_ == AF_INET
+				&& (this->header_included_ || this->protocol_ == IPPROTO_RAW))) {
+			data += header_length;
+			length -= header_length;
+		}
+
+		std::vector<SOCKET_IOV_TYPE> iov;
+		AddSegment (&iov, (char *) data, length);
+
+		rc = this->SendSegments (iov, (struct sockaddr *) &address,
+				address_length);
+
+		if (rc == SOCKET_ERROR) {
+			int error = SOCKET_ERRNO;
+			if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS) {
+				replay->pending = true;
+				uv_timer_start (replay->timer, ReplayEvent, 1, 0);
+				return;
+			}
+			replay->errors++;
+			continue;
+		}
+
+		if (this->capture_)
+			this->CaptureOut (data, length, (struct sockaddr *) &address);
+
+		replay->packets++;
+		replay->bytes += length;
+	}
+
+	uv_timer_start (replay->timer, ReplayEvent, 0, 0);
+}
+
+#define SCAN_BUDGET 1024
+#define SCAN_FLUSH_INTERVAL 10
+
+/**
+ ** Sends every probe which is due, up to a fixed budget per event loop
+ ** iteration, and delivers the results collected since the last run.  Once
+ ** every probe has been sent the timer keeps running, to deliver results,
+ ** until the time allowed for the last replies to arrive has passed.
+ **/
+void SocketWrap::HandleScan (void) {
+	ScanState *scan = this->scan_;
+	char packet[SCAN_PROBE_LENGTH];
+	unsigned int count = 0;
+	uint64_t delay = 0;
+
+	while (scan->sending && count++ < SCAN_BUDGET) {
+		if (scan->next >= scan->total) {
+			scan->sending = false;
+			scan->deadline = uv_now (uv_default_loop ()) + scan->wait;
+			break;
+		}
+
+		if (scan->rate > 0) {
+			double elapsed = (uv_hrtime () - scan->start) / 1e9;
+			if ((double) scan->next >= elapsed * scan->rate) {
+				delay = 1 + (uint64_t) ((scan->next / scan->rate - elapsed)
+						* 1000);
+				break;
+			}
+		}
+
+		/**
+		 ** Targets change fastest so probes to each host are spread out.
+		 **/
+		size_t targets = scan->targets.size ();
+		struct sockaddr *target = (struct sockaddr *)
+				&scan->targets[scan->next % targets];
+		uint16_t port = scan->ports[scan->next / targets];
+
+		size_t length = scan->scanner.Probe (target, port, packet);
+
+		std::vector<SOCKET_IOV_TYPE> iov;
+		AddSegment (&iov, packet, length);
+
+		int rc = this->SendSegments (iov, target, this->family_ == AF_INET6
+				? sizeof (struct sockaddr_in6)
+				: sizeof (struct sockaddr_in));
+
+		if (rc == SOCKET_ERROR) {
+			int error = SOCKET_ERRNO;
+			if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS) {
+				delay = 1;
+				break;
+			}
+			scan->errors++;
+		} else {
+			scan->sent++;
+			if (this->capture_)
+				this->CaptureOut (packet, length, target);
+		}
+
+		scan->next++;
+	}
+
+	/**
+	 ** The event handler may close the socket or stop the scan.
+	 **/
+	if (scan->results.size ()) {
+		this->EmitScanResults (scan->results);
+		if (this->scan_ != scan)
+			return;
+	}
+
+	if (scan->sending) {
+		uv_timer_start (scan->timer, ScanEvent, delay, 0);
+		return;
+	}
+
+	uint64_t now = uv_now (uv_default_loop ());
+	if (now >= scan->deadline) {
+		this->FinishScan (0);
+		return;
+	}
+
+	uv_timer_start (scan->timer, ScanEvent,
+			scan->deadline - now < SCAN_FLUSH_INTERVAL
+					? scan->deadline - now
+					: SCAN_FLUSH_INTERVAL,
+			0);
+}
+
+#define SCAN_RECV_BUDGET 256
+
+/**
+ ** While scanning the socket is read from here, so replies to probes never
+ ** reach JavaScript one at a time, anything else is delivered in a batch.
+ **/
+void SocketWrap::HandleScanRecv (void) {
+	ScanState *scan = this->scan_;
+	Local<Array> buffers = Nan::New<Array>();
+	Local<Array> sources = Nan::New<Array>();
+	uint32_t received = 0;
+	int error = 0;
+	char addr[50];
+
+	for (unsigned int i = 0; i < SCAN_RECV_BUDGET; i++) {
+		struct sockaddr_storage from;
+		char *data = &scan->buffer[0];
+
+		int rc = this->RecvPacket (data, scan->buffer.size (), &from);
+		if (rc == SOCKET_ERROR) {
+			if (SOCKET_ERRNO != EAGAIN && SOCKET_ERRNO != EWOULDBLOCK)
+				error = SOCKET_ERRNO;
+			break;
+		}
+
+		if (this->capture_)
+			this->CaptureIn (data, rc, (struct sockaddr *) &from);
+
+		const char *datagram;
+		size_t datagram_length;
+
+		if (! this->Reassemble (data, rc, &datagram, &datagram_length))
+			continue;
+
+		if (this->ScanReply (datagram, datagram_length,
+				(struct sockaddr *) &from))
+			continue;
+
+		if (from.ss_family == AF_INET6)
+			uv_ip6_name ((struct sockaddr_in6 *) &from, addr, 50);
+		else
+			uv_ip4_name ((struct sockaddr_in *) &from, addr, 50);
+
+		Nan::Set(buffers, received, Nan::CopyBuffer(datagram,
+				(uint32_t) datagram_length).ToLocalChecked());
+		Nan::Set(sources, received, Nan::New(addr).ToLocalChecked());
+		received++;
+	}
+
+	if (received) {
+		Local<Value> args[3];
+		args[0] = Nan::New<String>("recvBatch").ToLocalChecked();
+		args[1] = buffers;
+		args[2] = sources;
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 3, args);
+	}
+
+	if (error) {
+		Local<Value> args[2];
+		args[0] = Nan::New<String>("error").ToLocalChecked();
+		args[1] = Nan::Error(raw_strerror (error));
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 2, args);
+	}
+}
+
+NAN_METHOD(SocketWrap::New) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = new SocketWrap ();
+	int rc, family = AF_INET;
+	
+	if (info.Length () < 1) {
+		Nan::ThrowError("One argument is required");
+		return;
+	}
+	
+	if (! info[0]->IsUint32 ()) {
+		Nan::ThrowTypeError("Protocol argument must be an unsigned integer");
+		return;
+	} else {
+		socket->protocol_ = Nan::To<Uint32>(info[0]).ToLocalChecked()->Value();
+	}
+
+	if (info.Length () > 1) {
+		if (! info[1]->IsUint32 ()) {
+			Nan::ThrowTypeError("Address family argument must be an unsigned integer");
+			return;
+		} else {
+			if (Nan::To<Uint32>(info[1]).ToLocalChecked()->Value() == 2)
+				family = AF_INET6;
+		}
 	}
 	
 	socket->family_ = family;
+
+	socket->engine_ = ENGINE_POLL;
+	if (info.Length () > 2) {
+		if (! info[2]->IsUint32 ()) {
+			Nan::ThrowTypeError("Engine argument must be an unsigned integer");
+			return;
+		}
+		socket->engine_ = Nan::To<Uint32>(info[2]).ToLocalChecked()->Value();
+	}
+
+	socket->buffer_size_ = 4096;
+	if (info.Length () > 3) {
+		if (! info[3]->IsUint32 ()) {
+			Nan::ThrowTypeError("Buffer size argument must be an unsigned integer");
+			return;
+		}
+		socket->buffer_size_ = Nan::To<Uint32>(info[3]).ToLocalChecked()->Value();
+	}
+	
+	bool recv_errors = false;
+	if (info.Length () > 4) {
+		if (! info[4]->IsBoolean ()) {
+			Nan::ThrowTypeError("Receive errors argument must be a boolean");
+			return;
+		}
+		recv_errors = Nan::To<Boolean>(info[4]).ToLocalChecked()->Value();
+	}
+
+	if (info.Length () > 5) {
+		if (! info[5]->IsString ()) {
+			Nan::ThrowTypeError("TUN device argument must be a string");
+			return;
+		}
+		socket->tun_name_ = *Nan::Utf8String(info[5]);
+		socket->tun_ = socket->tun_name_.length () > 0;
+	}
+
+	if (socket->tun_) {
+#ifdef RAW_HAVE_TUN
+		if (socket->tun_name_.length () >= IFNAMSIZ) {
+			Nan::ThrowRangeError("TUN device name is too long");
+			return;
+		}
+#else
+		Nan::ThrowError("TUN devices are only supported on Linux");
+		return;
+#endif
+	}
 	
 	socket->poll_initialised_ = false;
 	
@@ -469,6 +1598,19 @@ NAN_METHOD(SocketWrap::New) {
 		return;
 	}
 
+	if (recv_errors) {
+#ifdef RAW_HAVE_ERRQUEUE
+		rc = socket->SetRecvErrors (true);
+		if (rc != 0) {
+			Nan::ThrowError(raw_strerror (rc));
+			return;
+		}
+#else
+		Nan::ThrowError("Receiving errors is only supported on Linux");
+		return;
+#endif
+	}
+
 	socket->Wrap (info.This ());
 
 	info.GetReturnValue().Set(info.This());
@@ -500,36 +1642,76 @@ NAN_METHOD(SocketWrap::Pause) {
 	}
 	bool pause_send = Nan::To<Boolean>(info[1]).ToLocalChecked()->Value();
 	
-	int events = (pause_recv ? 0 : UV_READABLE)
-			| (pause_send ? 0 : UV_WRITABLE);
+#ifdef RAW_HAVE_URING
+	/**
+	 ** Sends are submitted straight to the ring so there is nothing to do
+	 ** for the send state, pausing receive cancels the multishot request so
+	 ** packets queue up on the socket as they would when polling.
+	 **/
+	if (socket->uring_) {
+		if (! socket->deconstructing_ && socket->poll_initialised_) {
+			if (pause_recv)
+				socket->uring_->StopRecv ();
+			else
+				socket->uring_->StartRecv ();
+			socket->uring_recv_ = ! pause_recv;
+			socket->UpdateUringPoll ();
+		}
 
-	if (! socket->deconstructing_ && socket->poll_initialised_) {
-		uv_poll_stop (socket->poll_watcher_);
-		if (events)
-			uv_poll_start (socket->poll_watcher_, events, IoEvent);
+		info.GetReturnValue().Set(info.This());
+		return;
 	}
+#endif
+
+	socket->events_ = (pause_recv ? 0 : UV_READABLE)
+			| (pause_send ? 0 : UV_WRITABLE);
+
+	socket->UpdatePoll ();
 	
 	info.GetReturnValue().Set(info.This());
 }
 
+/**
+ ** Returns true when there is something to deliver, which is either the
+ ** packet itself or a complete datagram owned by the reassembler.
+ **/
+bool SocketWrap::Reassemble (const char *data, size_t length,
+		const char **datagram, size_t *datagram_length) {
+	if (! this->reassembler_) {
+		*datagram = data;
+		*datagram_length = length;
+		return true;
+	}
+
+	bool deliver = this->reassembler_->Add (data, length,
+			uv_now (uv_default_loop ()), datagram, datagram_length);
+
+	if (this->reassembler_->Pending ()) {
+		if (! this->reassembly_timer_) {
+			this->reassembly_timer_ = new uv_timer_t;
+			uv_timer_init (uv_default_loop (), this->reassembly_timer_);
+			uv_unref ((uv_handle_t *) this->reassembly_timer_);
+			this->reassembly_timer_->data = this;
+		}
+
+		if (! uv_is_active ((uv_handle_t *) this->reassembly_timer_)) {
+			uint64_t interval = this->reassembler_->Interval ();
+			uv_timer_start (this->reassembly_timer_, ReassemblyEvent,
+					interval, interval);
+		}
+	}
+
+	return deliver;
+}
+
 NAN_METHOD(SocketWrap::Recv) {
 	Nan::HandleScope scope;
 	
 	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
 	Local<Object> buffer;
-	sockaddr_in sin_address;
-	sockaddr_in6 sin6_address;
+	struct sockaddr_storage from;
 	char addr[50];
 	int rc;
-#ifdef _WIN32
-	int sin_length = socket->family_ == AF_INET6
-			? sizeof (sin6_address)
-			: sizeof (sin_address);
-#else
-	socklen_t sin_length = socket->family_ == AF_INET6
-			? sizeof (sin6_address)
-			: sizeof (sin_address);
-#endif
 	
 	if (info.Length () < 2) {
 		Nan::ThrowError("Five arguments are required");
@@ -554,197 +1736,1466 @@ NAN_METHOD(SocketWrap::Recv) {
 		return;
 	}
 
-	if (socket->family_ == AF_INET6) {
-		memset (&sin6_address, 0, sizeof (sin6_address));
-		rc = recvfrom (socket->poll_fd_, node::Buffer::Data (buffer),
-				(int) node::Buffer::Length (buffer), 0, (sockaddr *) &sin6_address,
-				&sin_length);
-	} else {
-		memset (&sin_address, 0, sizeof (sin_address));
-		rc = recvfrom (socket->poll_fd_, node::Buffer::Data (buffer),
-				(int) node::Buffer::Length (buffer), 0, (sockaddr *) &sin_address,
-				&sin_length);
-	}
+	rc = socket->RecvPacket (node::Buffer::Data (buffer),
+			node::Buffer::Length (buffer), &from);
 	
 	if (rc == SOCKET_ERROR) {
 		Nan::ThrowError(raw_strerror (SOCKET_ERRNO));
 		return;
 	}
 	
-	if (socket->family_ == AF_INET6)
-		uv_ip6_name (&sin6_address, addr, 50);
+	if (from.ss_family == AF_INET6)
+		uv_ip6_name ((struct sockaddr_in6 *) &from, addr, 50);
 	else
-		uv_ip4_name (&sin_address, addr, 50);
+		uv_ip4_name ((struct sockaddr_in *) &from, addr, 50);
+
+	if (socket->capture_)
+		socket->CaptureIn (node::Buffer::Data (buffer), rc,
+				(struct sockaddr *) &from);
+
+	/**
+	 ** A reassembled datagram can be larger than the buffer, so it is given
+	 ** a buffer of its own, and fragments are not delivered at all.
+	 **/
+	const char *datagram;
+	size_t datagram_length;
+
+	if (! socket->Reassemble (node::Buffer::Data (buffer), rc, &datagram,
+			&datagram_length)
+			|| socket->ScanReply (datagram, datagram_length,
+					(struct sockaddr *) &from)) {
+		info.GetReturnValue().Set(info.This());
+		return;
+	}
 	
 	Local<Function> cb = Local<Function>::Cast (info[1]);
 	const unsigned argc = 3;
 	Local<Value> argv[argc];
-	argv[0] = info[0];
-	argv[1] = Nan::New<Number>(rc);
+	if (datagram == node::Buffer::Data (buffer))
+		argv[0] = info[0];
+	else
+		argv[0] = Nan::CopyBuffer(datagram,
+				(uint32_t) datagram_length).ToLocalChecked();
+	argv[1] = Nan::New<Number>((double) datagram_length);
 	argv[2] = Nan::New(addr).ToLocalChecked();
 	Nan::Call(Nan::Callback(cb), argc, argv);
 	
 	info.GetReturnValue().Set(info.This());
 }
 
-NAN_METHOD(SocketWrap::Send) {
+/**
+ ** Packets read from a TUN device carry no address of their own, the source
+ ** address is taken from the IP header instead.
+ **/
+int SocketWrap::RecvPacket (char *data, size_t length,
+		struct sockaddr_storage *from) {
+	SOCKET_LEN_TYPE from_length = sizeof (*from);
+
+	memset (from, 0, sizeof (*from));
+
+#ifdef RAW_HAVE_TUN
+	if (this->tun_) {
+		int rc = (int) read (this->poll_fd_, data, length);
+		if (rc == SOCKET_ERROR)
+			return rc;
+
+		if (rc >= 40 && (data[0] & 0xf0) == 0x60) {
+			struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) from;
+			sin6->sin6_family = AF_INET6;
+			memcpy (&sin6->sin6_addr, data + 8, 16);
+		} else {
+			struct sockaddr_in *sin = (struct sockaddr_in *) from;
+			sin->sin_family = AF_INET;
+			if (rc >= 20)
+				memcpy (&sin->sin_addr, data + 12, 4);
+		}
+
+		return rc;
+	}
+#endif
+
+	/**
+	 ** Default to the family of the socket in case the address is not
+	 ** filled in.
+	 **/
+	from->ss_family = this->family_;
+
+	return recvfrom (this->poll_fd_, data, (int) length, 0,
+			(struct sockaddr *) from, &from_length);
+}
+
+NAN_METHOD(SocketWrap::Replay) {
 	Nan::HandleScope scope;
 	
 	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
-	Local<Object> buffer;
-	uint32_t offset;
-	uint32_t length;
-	int rc;
-	char *data;
 	
-	if (info.Length () < 5) {
-		Nan::ThrowError("Five arguments are required");
+	if (info.Length () < 4) {
+		Nan::ThrowError("Four arguments are required");
 		return;
 	}
-	
-	if (! node::Buffer::HasInstance (info[0])) {
-		Nan::ThrowTypeError("Buffer argument must be a node Buffer object");
+
+	if (! info[0]->IsString ()) {
+		Nan::ThrowTypeError("Path argument must be a string");
 		return;
 	}
-	
-	if (! info[1]->IsUint32 ()) {
-		Nan::ThrowTypeError("Offset argument must be an unsigned integer");
+
+	if (! info[1]->IsNumber ()) {
+		Nan::ThrowTypeError("Rate argument must be a number");
 		return;
 	}
 
-	if (! info[2]->IsUint32 ()) {
-		Nan::ThrowTypeError("Length argument must be an unsigned integer");
+	double rate = Nan::To<Number>(info[1]).ToLocalChecked()->Value();
+	if (! (rate >= 0)) {
+		Nan::ThrowRangeError("Rate argument cannot be negative");
 		return;
 	}
 
-	if (! info[3]->IsString ()) {
+	if (! info[2]->IsString ()) {
 		Nan::ThrowTypeError("Address argument must be a string");
 		return;
 	}
 
-	if (! info[4]->IsFunction ()) {
+	if (! info[3]->IsFunction ()) {
 		Nan::ThrowTypeError("Callback argument must be a function");
 		return;
 	}
 
-	rc = socket->CreateSocket ();
-	if (rc != 0) {
-		Nan::ThrowError(raw_strerror (errno));
+	if (socket->replay_) {
+		Nan::ThrowError("A replay is already in progress");
 		return;
 	}
-	
-	buffer = Nan::To<Object>(info[0]).ToLocalChecked();
-	offset = Nan::To<Uint32>(info[1]).ToLocalChecked()->Value();
-	length = Nan::To<Uint32>(info[2]).ToLocalChecked()->Value();
-
-	data = node::Buffer::Data (buffer) + offset;
-	
-	if (socket->family_ == AF_INET6) {
-#if UV_VERSION_MAJOR > 0
-		struct sockaddr_in6 addr;
 
-		uv_ip6_addr(*Nan::Utf8String(info[3]), 0, &addr);
-#else
-		String::Utf8String address (args[3]);
-		struct sockaddr_in6 addr = uv_ip6_addr (*address, 0);
-#endif
-		
-		rc = sendto (socket->poll_fd_, data, length, 0,
-				(struct sockaddr *) &addr, sizeof (addr));
-	} else {
-#if UV_VERSION_MAJOR > 0
-		struct sockaddr_in addr;
-		uv_ip4_addr(*Nan::Utf8String(info[3]), 0, &addr);
-#else
-		String::Utf8String address (info[3]);
-		struct sockaddr_in addr = uv_ip4_addr (*address, 0);
-#endif
+	int rc = socket->CreateSocket ();
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
 
-		rc = sendto (socket->poll_fd_, data, length, 0,
-				(struct sockaddr *) &addr, sizeof (addr));
+	ReplayState *replay = new ReplayState ();
+	replay->pending = false;
+	replay->started = false;
+	replay->rate = rate;
+	replay->base = 0;
+	replay->start = 0;
+	replay->packets = 0;
+	replay->bytes = 0;
+	replay->skipped = 0;
+	replay->errors = 0;
+
+	replay->override = Nan::Utf8String(info[2]).length() > 0;
+	if (replay->override && ParseAddress (socket->family_, info[2],
+			&replay->address, &replay->address_length) != 0) {
+		delete replay;
+		Nan::ThrowError("Invalid address");
+		return;
 	}
-	
-	if (rc == SOCKET_ERROR) {
-		Nan::ThrowError(raw_strerror (SOCKET_ERRNO));
+
+	rc = replay->reader.Open (*Nan::Utf8String(info[0]));
+	if (rc != 0) {
+		delete replay;
+		Nan::ThrowError(rc == CAPTURE_EFORMAT
+				? "Unsupported or corrupt capture file"
+				: raw_strerror (rc));
 		return;
 	}
-	
-	Local<Function> cb = Local<Function>::Cast (info[4]);
-	const unsigned argc = 1;
-	Local<Value> argv[argc];
-	argv[0] = Nan::New<Number>(rc);
-	Nan::Call(Nan::Callback(cb), argc, argv);
-	
+
+	replay->callback.Reset (Local<Function>::Cast (info[3]));
+
+	replay->timer = new uv_timer_t;
+	uv_timer_init (uv_default_loop (), replay->timer);
+	replay->timer->data = socket;
+	uv_timer_start (replay->timer, ReplayEvent, 0, 0);
+
+	socket->replay_ = replay;
+
 	info.GetReturnValue().Set(info.This());
 }
 
-NAN_METHOD(SocketWrap::SetOption) {
+/**
+ ** IPv4 probes are sent with their IP header, so the socket has IP_HDRINCL
+ ** enabled for the duration of the scan, for IPv6 the kernel is asked to
+ ** fill in the TCP checksum instead.
+ **/
+NAN_METHOD(SocketWrap::Scan) {
 	Nan::HandleScope scope;
 	
 	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
 	
-	if (info.Length () < 3) {
-		Nan::ThrowError("Three or four arguments are required");
+	if (info.Length () < 8) {
+		Nan::ThrowError("Eight arguments are required");
 		return;
 	}
 
-	if (! info[0]->IsNumber ()) {
-		Nan::ThrowTypeError("Level argument must be a number");
+	if (! info[0]->IsArray ()) {
+		Nan::ThrowTypeError("Targets argument must be an array");
 		return;
 	}
 
-	if (! info[1]->IsNumber ()) {
-		Nan::ThrowTypeError("Option argument must be a number");
+	if (! info[1]->IsArray ()) {
+		Nan::ThrowTypeError("Ports argument must be an array");
 		return;
 	}
 
-	int level = Nan::To<Uint32>(info[0]).ToLocalChecked()->Value();
-	int option = Nan::To<Uint32>(info[1]).ToLocalChecked()->Value();
-	SOCKET_OPT_TYPE val = NULL;
-	unsigned int ival = 0;
-	SOCKET_LEN_TYPE len;
+	if (! info[2]->IsString ()) {
+		Nan::ThrowTypeError("Source argument must be a string");
+		return;
+	}
 
-	if (info.Length () > 3) {
-		if (! node::Buffer::HasInstance (info[2])) {
-			Nan::ThrowTypeError("Value argument must be a node Buffer object if length is provided");
+	if (! info[3]->IsUint32 ()
+			|| Nan::To<Uint32>(info[3]).ToLocalChecked()->Value() < 1
+			|| Nan::To<Uint32>(info[3]).ToLocalChecked()->Value() > 65535) {
+		Nan::ThrowRangeError("Source port argument must be a port number");
+		return;
+	}
+
+	if (! info[4]->IsNumber ()) {
+		Nan::ThrowTypeError("Rate argument must be a number");
+		return;
+	}
+
+	double rate = Nan::To<Number>(info[4]).ToLocalChecked()->Value();
+	if (! (rate >= 0)) {
+		Nan::ThrowRangeError("Rate argument cannot be negative");
+		return;
+	}
+
+	if (! info[5]->IsUint32 ()) {
+		Nan::ThrowTypeError("Wait argument must be an unsigned integer");
+		return;
+	}
+
+	if (! info[6]->IsUint32 ()
+			|| Nan::To<Uint32>(info[6]).ToLocalChecked()->Value() < 1
+			|| Nan::To<Uint32>(info[6]).ToLocalChecked()->Value() > 255) {
+		Nan::ThrowRangeError("TTL argument must be between 1 and 255");
+		return;
+	}
+
+	if (! info[7]->IsFunction ()) {
+		Nan::ThrowTypeError("Callback argument must be a function");
+		return;
+	}
+
+	if (socket->scan_) {
+		Nan::ThrowError("A scan is already in progress");
+		return;
+	}
+
+	if (socket->protocol_ != IPPROTO_TCP || socket->tun_) {
+		Nan::ThrowError("Scanning requires a raw socket using the TCP protocol");
+		return;
+	}
+
+	int rc = socket->CreateSocket ();
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	ScanState *scan = new ScanState ();
+	SOCKET_LEN_TYPE address_length;
+
+	Local<Array> targets = Local<Array>::Cast (info[0]);
+	scan->targets.resize (targets->Length ());
+	for (uint32_t i = 0; i < targets->Length (); i++) {
+		Local<Value> target = Nan::Get(targets, i).ToLocalChecked();
+		if (! target->IsString () || ParseAddress (socket->family_, target,
+				&scan->targets[i], &address_length) != 0) {
+			delete scan;
+			Nan::ThrowError("Invalid target address");
 			return;
 		}
-		
-		Local<Object> buffer = Nan::To<Object>(info[2]).ToLocalChecked();
-		val = node::Buffer::Data (buffer);
+	}
 
-		if (! info[3]->IsInt32 ()) {
-			Nan::ThrowTypeError("Length argument must be an unsigned integer");
+	Local<Array> ports = Local<Array>::Cast (info[1]);
+	for (uint32_t i = 0; i < ports->Length (); i++) {
+		Local<Value> port = Nan::Get(ports, i).ToLocalChecked();
+		if (! port->IsUint32 ()
+				|| Nan::To<Uint32>(port).ToLocalChecked()->Value() > 65535) {
+			delete scan;
+			Nan::ThrowRangeError("Each port must be a port number");
 			return;
 		}
+		scan->ports.push_back ((uint16_t) Nan::To<Uint32>(port)
+				.ToLocalChecked()->Value());
+	}
 
-		len = Nan::To<Uint32>(info[3]).ToLocalChecked()->Value();
+	struct sockaddr_storage source;
+	memset (&source, 0, sizeof (source));
 
-		if (len > node::Buffer::Length (buffer)) {
-			Nan::ThrowTypeError("Length argument is larger than buffer length");
-			return;
+	if (socket->family_ == AF_INET
+			&& ParseAddress (AF_INET, info[2], &source, &address_length) != 0) {
+		delete scan;
+		Nan::ThrowError("A valid source address is required to scan using IPv4");
+		return;
+	}
+
+	rc = scan->scanner.Open (socket->family_, (struct sockaddr *) &source,
+			(uint16_t) Nan::To<Uint32>(info[3]).ToLocalChecked()->Value(),
+			(uint8_t) Nan::To<Uint32>(info[6]).ToLocalChecked()->Value());
+	if (rc != 0) {
+		delete scan;
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	/**
+	 ** Any checksum offset already set, e.g. using setOption(), is put back
+	 ** once the scan is over.
+	 **/
+	scan->restore = false;
+	if (socket->family_ == AF_INET6) {
+		SOCKET_LEN_TYPE length = sizeof (scan->checksum_offset);
+		rc = getsockopt (socket->poll_fd_, IPPROTO_IPV6, IPV6_CHECKSUM,
+				(SOCKET_OPT_TYPE) &scan->checksum_offset, &length);
+		if (rc != SOCKET_ERROR && scan->checksum_offset != 16) {
+			int offset = 16;
+			rc = setsockopt (socket->poll_fd_, IPPROTO_IPV6, IPV6_CHECKSUM,
+					(SOCKET_OPT_TYPE) &offset, sizeof (offset));
+			scan->restore = true;
 		}
+	} else if (! socket->header_included_) {
+		int include = 1;
+		rc = setsockopt (socket->poll_fd_, IPPROTO_IP, IP_HDRINCL,
+				(SOCKET_OPT_TYPE) &include, sizeof (include));
+		socket->header_included_ = true;
+		scan->restore = true;
+	}
+
+	if (rc == SOCKET_ERROR) {
+		delete scan;
+		Nan::ThrowError(raw_strerror (SOCKET_ERRNO));
+		return;
+	}
+
+	scan->next = 0;
+	scan->total = (uint64_t) scan->targets.size () * scan->ports.size ();
+	scan->rate = rate;
+	scan->start = uv_hrtime ();
+	scan->wait = Nan::To<Uint32>(info[5]).ToLocalChecked()->Value();
+	scan->deadline = 0;
+	scan->sending = true;
+	scan->sent = 0;
+	scan->errors = 0;
+	scan->open = 0;
+	scan->closed = 0;
+	scan->buffer.resize (socket->buffer_size_ ? socket->buffer_size_ : 4096);
+
+	scan->callback.Reset (Local<Function>::Cast (info[7]));
+
+	scan->timer = new uv_timer_t;
+	uv_timer_init (uv_default_loop (), scan->timer);
+	scan->timer->data = socket;
+	uv_timer_start (scan->timer, ScanEvent, 0, 0);
+
+	socket->scan_ = scan;
+
+	info.GetReturnValue().Set(info.This());
+}
+
+bool SocketWrap::ScanReply (const char *data, size_t length,
+		const struct sockaddr *from) {
+	ScanResult result;
+
+	if (! this->scan_
+			|| ! this->scan_->scanner.Match (data, length, from, &result))
+		return false;
+
+	if (result.open)
+		this->scan_->open++;
+	else
+		this->scan_->closed++;
+
+	this->scan_->results.push_back (result);
+
+	return true;
+}
+
+NAN_METHOD(SocketWrap::Send) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	std::vector<SOCKET_IOV_TYPE> iov;
+	uint32_t offset;
+	uint32_t length;
+	int rc;
+	
+	if (info.Length () < 5) {
+		Nan::ThrowError("Five arguments are required");
+		return;
+	}
+	
+	if (! info[1]->IsUint32 ()) {
+		Nan::ThrowTypeError("Offset argument must be an unsigned integer");
+		return;
+	}
+
+	if (! info[2]->IsUint32 ()) {
+		Nan::ThrowTypeError("Length argument must be an unsigned integer");
+		return;
+	}
+
+	if (! info[3]->IsString ()) {
+		Nan::ThrowTypeError("Address argument must be a string");
+		return;
+	}
+
+	if (! info[4]->IsFunction ()) {
+		Nan::ThrowTypeError("Callback argument must be a function");
+		return;
+	}
+
+	rc = socket->CreateSocket ();
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (errno));
+		return;
+	}
+	
+	offset = Nan::To<Uint32>(info[1]).ToLocalChecked()->Value();
+	length = Nan::To<Uint32>(info[2]).ToLocalChecked()->Value();
+
+	if (! ParseSegments (info[0], offset, length, &iov))
+		return;
+	
+	if (socket->family_ == AF_INET6) {
+#if UV_VERSION_MAJOR > 0
+		struct sockaddr_in6 addr;
+
+		uv_ip6_addr(*Nan::Utf8String(info[3]), 0, &addr);
+#else
+		String::Utf8String address (args[3]);
+		struct sockaddr_in6 addr = uv_ip6_addr (*address, 0);
+#endif
+		
+		rc = socket->SendSegments (iov, (struct sockaddr *) &addr,
+				sizeof (addr));
+
+		if (rc != SOCKET_ERROR && socket->capture_)
+			socket->CaptureSegments (iov, (struct sockaddr *) &addr);
 	} else {
-		if (! info[2]->IsUint32 ()) {
-			Nan::ThrowTypeError("Value argument must be a unsigned integer");
+#if UV_VERSION_MAJOR > 0
+		struct sockaddr_in addr;
+		uv_ip4_addr(*Nan::Utf8String(info[3]), 0, &addr);
+#else
+		String::Utf8String address (info[3]);
+		struct sockaddr_in addr = uv_ip4_addr (*address, 0);
+#endif
+
+		rc = socket->SendSegments (iov, (struct sockaddr *) &addr,
+				sizeof (addr));
+
+		if (rc != SOCKET_ERROR && socket->capture_)
+			socket->CaptureSegments (iov, (struct sockaddr *) &addr);
+	}
+	
+	if (rc == SOCKET_ERROR) {
+		Nan::ThrowError(raw_strerror (SOCKET_ERRNO));
+		return;
+	}
+	
+	Local<Function> cb = Local<Function>::Cast (info[4]);
+	const unsigned argc = 1;
+	Local<Value> argv[argc];
+	argv[0] = Nan::New<Number>(rc);
+	Nan::Call(Nan::Callback(cb), argc, argv);
+	
+	info.GetReturnValue().Set(info.This());
+}
+
+#ifdef _WIN32
+#define ADDRESS_INVALID WSAEINVAL
+#else
+#define ADDRESS_INVALID EINVAL
+#endif
+
+static int ParseAddress (uint32_t family, Local<Value> value,
+		struct sockaddr_storage *address, SOCKET_LEN_TYPE *length) {
+	Nan::Utf8String string (value);
+
+	memset (address, 0, sizeof (*address));
+
+	if (family == AF_INET6) {
+		*length = sizeof (struct sockaddr_in6);
+		return uv_ip6_addr (*string, 0, (struct sockaddr_in6 *) address);
+	} else {
+		*length = sizeof (struct sockaddr_in);
+		return uv_ip4_addr (*string, 0, (struct sockaddr_in *) address);
+	}
+}
+
+NAN_METHOD(SocketWrap::SendBatch) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	Local<Array> requests;
+	int rc;
+	
+	if (info.Length () < 2) {
+		Nan::ThrowError("Two arguments are required");
+		return;
+	}
+	
+	if (! info[0]->IsArray ()) {
+		Nan::ThrowTypeError("Requests argument must be an array");
+		return;
+	} else {
+		requests = Local<Array>::Cast (info[0]);
+	}
+
+	if (! info[1]->IsFunction ()) {
+		Nan::ThrowTypeError("Callback argument must be a function");
+		return;
+	}
+
+	rc = socket->CreateSocket ();
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (errno));
+		return;
+	}
+
+	uint32_t count = requests->Length ();
+	std::vector<int> results (count, 0);
+	std::vector<SOCKET_IOV_TYPE> iov;
+
+	Local<String> buffer_key = Nan::New("buffer").ToLocalChecked();
+	Local<String> offset_key = Nan::New("offset").ToLocalChecked();
+	Local<String> length_key = Nan::New("length").ToLocalChecked();
+	Local<String> address_key = Nan::New("address").ToLocalChecked();
+
+	/**
+	 ** Validate everything up front so a bad request never leaves a batch
+	 ** half submitted.
+	 **/
+	for (uint32_t i = 0; i < count; i++) {
+		Local<Value> value = Nan::Get(requests, i).ToLocalChecked();
+		if (! value->IsObject ()) {
+			Nan::ThrowTypeError("Each request must be an object");
 			return;
 		}
+		Local<Object> request = Nan::To<Object>(value).ToLocalChecked();
 
-		ival = Nan::To<Uint32>(info[2]).ToLocalChecked()->Value();
-		len = 4;
+		Local<Value> buffer = Nan::Get(request, buffer_key).ToLocalChecked();
+		Local<Value> offset = Nan::Get(request, offset_key).ToLocalChecked();
+		Local<Value> length = Nan::Get(request, length_key).ToLocalChecked();
+
+		if (! offset->IsUint32 () || ! length->IsUint32 ()) {
+			Nan::ThrowTypeError("Offset and length attributes must be unsigned integers");
+			return;
+		}
+		if (! ParseSegments (buffer,
+				Nan::To<Uint32>(offset).ToLocalChecked()->Value(),
+				Nan::To<Uint32>(length).ToLocalChecked()->Value(), &iov))
+			return;
+		if (! Nan::Get(request, address_key).ToLocalChecked()->IsString ()) {
+			Nan::ThrowTypeError("Address attribute must be a string");
+			return;
+		}
 	}
 
-	int rc = setsockopt (socket->poll_fd_, level, option,
-			(val ? val : (SOCKET_OPT_TYPE) &ival), len);
+#ifdef RAW_HAVE_URING
+	if (socket->uring_) {
+		UringBatch *batch = new UringBatch ();
+		batch->callback.Reset (Local<Function>::Cast (info[1]));
+		batch->results.assign (count, 0);
+		batch->remaining = count;
 
-	if (rc == SOCKET_ERROR) {
-		Nan::ThrowError(raw_strerror(SOCKET_ERRNO));
-		return;
+		/**
+		 ** Hold one extra reference while queueing so the batch cannot be
+		 ** completed, and freed, before the loop below is done with it.
+		 **/
+		batch->remaining++;
+
+		for (uint32_t i = 0; i < count; i++) {
+			Local<Object> request = Nan::To<Object>(Nan::Get(requests, i)
+					.ToLocalChecked()).ToLocalChecked();
+			Local<Value> buffer = Nan::Get(request, buffer_key).ToLocalChecked();
+			uint32_t offset = Nan::To<Uint32>(Nan::Get(request, offset_key)
+					.ToLocalChecked()).ToLocalChecked()->Value();
+			uint32_t length = Nan::To<Uint32>(Nan::Get(request, length_key)
+					.ToLocalChecked()).ToLocalChecked()->Value();
+			struct sockaddr_storage address;
+			SOCKET_LEN_TYPE address_length;
+
+			/**
+			 ** A request with an invalid address fails on its own, the rest
+			 ** of the batch is still sent.
+			 **/
+			if (ParseAddress (socket->family_, Nan::Get(request, address_key)
+					.ToLocalChecked(), &address, &address_length) != 0) {
+				batch->results[i] = -ADDRESS_INVALID;
+				batch->remaining--;
+				continue;
+			}
+
+			uint32_t slot;
+			if (socket->uring_free_.size ()) {
+				slot = socket->uring_free_.back ();
+				socket->uring_free_.pop_back ();
+			} else {
+				slot = (uint32_t) socket->uring_sends_.size ();
+				socket->uring_sends_.push_back (new UringSend ());
+			}
+
+			UringSend *send = socket->uring_sends_[slot];
+
+			memcpy (&send->address, &address, sizeof (address));
+
+			ParseSegments (buffer, offset, length, &send->iov);
+			memset (&send->message, 0, sizeof (send->message));
+			send->message.msg_name = &send->address;
+			send->message.msg_namelen = address_length;
+			send->message.msg_iov = send->iov.size () ? &send->iov[0] : NULL;
+			send->message.msg_iovlen = send->iov.size ();
+
+			/**
+			 ** The callers array of segments could be changed before the
+			 ** send completes, so the buffers are held using a copy of it.
+			 **/
+			if (buffer->IsArray ()) {
+				Local<Array> segments = Local<Array>::Cast (buffer);
+				Local<Array> held = Nan::New<Array>();
+				for (uint32_t j = 0; j < segments->Length (); j++)
+					Nan::Set(held, j, Nan::Get(segments, j).ToLocalChecked());
+				send->buffer.Reset (held);
+			} else {
+				send->buffer.Reset (Nan::To<Object>(buffer).ToLocalChecked());
+			}
+			send->batch = batch;
+			send->index = i;
+
+			rc = socket->uring_->QueueSend (slot, &send->message);
+			if (rc != 0) {
+				batch->results[i] = -rc;
+				batch->remaining--;
+				send->batch = NULL;
+				send->buffer.Reset ();
+				socket->uring_free_.push_back (slot);
+			} else {
+				socket->uring_in_flight_++;
+
+				/**
+				 ** Sends are captured as they are queued, the result is
+				 ** not known until the completion arrives.
+				 **/
+				if (socket->capture_)
+					socket->CaptureSegments (send->iov,
+							(struct sockaddr *) &send->address);
+			}
+		}
+
+		socket->uring_->Submit ();
+		socket->UpdateUringPoll ();
+
+		/**
+		 ** Completions are delivered from the event loop, unless nothing
+		 ** could be queued at all in which case report straight away.
+		 **/
+		if (--batch->remaining > 0) {
+			info.GetReturnValue().Set(info.This());
+			return;
+		}
+
+		results = batch->results;
+		delete batch;
+	} else {
+#endif
+		for (uint32_t i = 0; i < count; i++) {
+			Local<Object> request = Nan::To<Object>(Nan::Get(requests, i)
+					.ToLocalChecked()).ToLocalChecked();
+			Local<Value> buffer = Nan::Get(request, buffer_key).ToLocalChecked();
+			uint32_t offset = Nan::To<Uint32>(Nan::Get(request, offset_key)
+					.ToLocalChecked()).ToLocalChecked()->Value();
+			uint32_t length = Nan::To<Uint32>(Nan::Get(request, length_key)
+					.ToLocalChecked()).ToLocalChecked()->Value();
+			struct sockaddr_storage address;
+			SOCKET_LEN_TYPE address_length;
+
+			/**
+			 ** Packets written to a TUN device carry their own destination.
+			 **/
+			if (ParseAddress (socket->family_, Nan::Get(request, address_key)
+					.ToLocalChecked(), &address, &address_length) != 0
+					&& ! socket->tun_) {
+				results[i] = -ADDRESS_INVALID;
+				continue;
+			}
+
+			ParseSegments (buffer, offset, length, &iov);
+			rc = socket->SendSegments (iov,
+					(struct sockaddr *) &address, address_length);
+
+			results[i] = rc == SOCKET_ERROR ? -SOCKET_ERRNO : rc;
+
+			if (rc != SOCKET_ERROR && socket->capture_)
+				socket->CaptureSegments (iov, (struct sockaddr *) &address);
+		}
+#ifdef RAW_HAVE_URING
 	}
+#endif
+
+	Local<Function> cb = Local<Function>::Cast (info[1]);
+	const unsigned argc = 1;
+	Local<Value> argv[argc];
+	argv[0] = SendResults (results);
+	Nan::Call(Nan::Callback(cb), argc, argv);
 	
 	info.GetReturnValue().Set(info.This());
 }
 
+/**
+ ** A TUN device takes the destination from the packet itself, so the address
+ ** is only used by raw sockets.
+ **/
+int SocketWrap::SendSegments (std::vector<SOCKET_IOV_TYPE> &iov,
+		struct sockaddr *address, SOCKET_LEN_TYPE address_length) {
+#ifdef _WIN32
+	DWORD sent = 0;
+
+	if (WSASendTo (this->poll_fd_, iov.size () ? &iov[0] : NULL,
+			(DWORD) iov.size (), &sent, 0, address, address_length, NULL,
+			NULL) == SOCKET_ERROR)
+		return SOCKET_ERROR;
+
+	return (int) sent;
+#else
+#ifdef RAW_HAVE_TUN
+	if (this->tun_)
+		return (int) writev (this->poll_fd_, iov.size () ? &iov[0] : NULL,
+				(int) iov.size ());
+#endif
+
+	struct msghdr message;
+
+	memset (&message, 0, sizeof (message));
+	message.msg_name = address;
+	message.msg_namelen = address_length;
+	message.msg_iov = iov.size () ? &iov[0] : NULL;
+	message.msg_iovlen = iov.size ();
+
+	return (int) sendmsg (this->poll_fd_, &message, 0);
+#endif
+}
+
+NAN_METHOD(SocketWrap::SetOption) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	
+	if (info.Length () < 3) {
+		Nan::ThrowError("Three or four arguments are required");
+		return;
+	}
+
+	if (! info[0]->IsNumber ()) {
+		Nan::ThrowTypeError("Level argument must be a number");
+		return;
+	}
+
+	if (! info[1]->IsNumber ()) {
+		Nan::ThrowTypeError("Option argument must be a number");
+		return;
+	}
+
+	int level = Nan::To<Uint32>(info[0]).ToLocalChecked()->Value();
+	int option = Nan::To<Uint32>(info[1]).ToLocalChecked()->Value();
+	SOCKET_OPT_TYPE val = NULL;
+	unsigned int ival = 0;
+	SOCKET_LEN_TYPE len;
+
+	if (info.Length () > 3) {
+		if (! node::Buffer::HasInstance (info[2])) {
+			Nan::ThrowTypeError("Value argument must be a node Buffer object if length is provided");
+			return;
+		}
+		
+		Local<Object> buffer = Nan::To<Object>(info[2]).ToLocalChecked();
+		val = node::Buffer::Data (buffer);
+
+		if (! info[3]->IsInt32 ()) {
+			Nan::ThrowTypeError("Length argument must be an unsigned integer");
+			return;
+		}
+
+		len = Nan::To<Uint32>(info[3]).ToLocalChecked()->Value();
+
+		if (len > node::Buffer::Length (buffer)) {
+			Nan::ThrowTypeError("Length argument is larger than buffer length");
+			return;
+		}
+	} else {
+		if (! info[2]->IsUint32 ()) {
+			Nan::ThrowTypeError("Value argument must be a unsigned integer");
+			return;
+		}
+
+		ival = Nan::To<Uint32>(info[2]).ToLocalChecked()->Value();
+		len = 4;
+	}
+
+	int rc = setsockopt (socket->poll_fd_, level, option,
+			(val ? val : (SOCKET_OPT_TYPE) &ival), len);
+
+	if (rc == SOCKET_ERROR) {
+		Nan::ThrowError(raw_strerror(SOCKET_ERRNO));
+		return;
+	}
+
+	/**
+	 ** The capture and replay features need to know whether packets sent
+	 ** include their IP header.
+	 **/
+	if (level == IPPROTO_IP && option == IP_HDRINCL) {
+		if (val)
+			memcpy (&ival, val, len < (SOCKET_LEN_TYPE) sizeof (ival)
+					? len : sizeof (ival));
+		socket->header_included_ = ival != 0;
+	}
+
+#ifdef RAW_HAVE_ERRQUEUE
+	/**
+	 ** Error reporting may also be switched on and off using setOption(),
+	 ** keep track so poll errors are handled accordingly.
+	 **/
+	if ((level == SOL_IP && option == IP_RECVERR)
+			|| (level == SOL_IPV6 && option == IPV6_RECVERR)) {
+		if (val)
+			memcpy (&ival, val, len < (SOCKET_LEN_TYPE) sizeof (ival)
+					? len : sizeof (ival));
+		socket->recv_errors_ = ival != 0;
+	}
+#endif
+	
+	info.GetReturnValue().Set(info.This());
+}
+
+#define CAPTURE_BUFFERS 16
+
+NAN_METHOD(SocketWrap::StartCapture) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	
+	if (info.Length () < 3) {
+		Nan::ThrowError("Three arguments are required");
+		return;
+	}
+
+	if (! info[0]->IsString ()) {
+		Nan::ThrowTypeError("Path argument must be a string");
+		return;
+	}
+
+	if (! info[1]->IsBoolean ()) {
+		Nan::ThrowTypeError("Sent argument must be a boolean");
+		return;
+	}
+
+	if (! info[2]->IsUint32 ()) {
+		Nan::ThrowTypeError("Buffer size argument must be an unsigned integer");
+		return;
+	}
+
+	if (socket->capture_) {
+		Nan::ThrowError("A capture is already in progress");
+		return;
+	}
+
+	CaptureWriter *capture = new CaptureWriter ();
+
+	int rc = capture->Open (*Nan::Utf8String(info[0]),
+			Nan::To<Uint32>(info[2]).ToLocalChecked()->Value(),
+			CAPTURE_BUFFERS);
+	if (rc != 0) {
+		delete capture;
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	socket->capture_ = capture;
+	socket->capture_sent_ = Nan::To<Boolean>(info[1]).ToLocalChecked()->Value();
+
+	info.GetReturnValue().Set(info.This());
+}
+
+/**
+ ** Packets must include their IP header to be reassembled, which IPv6 raw
+ ** sockets never receive, though the kernel reassembles anything addressed
+ ** to the host before raw sockets see it anyway.
+ **/
+NAN_METHOD(SocketWrap::StartReassembly) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	
+	if (info.Length () < 2) {
+		Nan::ThrowError("Two arguments are required");
+		return;
+	}
+
+	if (! info[0]->IsUint32 ()) {
+		Nan::ThrowTypeError("Memory argument must be an unsigned integer");
+		return;
+	}
+
+	if (! info[1]->IsUint32 ()) {
+		Nan::ThrowTypeError("Timeout argument must be an unsigned integer");
+		return;
+	}
+
+	if (socket->family_ == AF_INET6 && ! socket->tun_) {
+		Nan::ThrowError("IPv6 raw sockets do not receive IP headers, so cannot reassemble fragments");
+		return;
+	}
+
+	if (socket->reassembler_) {
+		Nan::ThrowError("Reassembly is already enabled");
+		return;
+	}
+
+	socket->reassembler_ = new Reassembler (
+			Nan::To<Uint32>(info[0]).ToLocalChecked()->Value(),
+			Nan::To<Uint32>(info[1]).ToLocalChecked()->Value());
+
+	info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(SocketWrap::StopCapture) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	CaptureStats capture_stats;
+
+	if (! socket->capture_) {
+		Nan::ThrowError("No capture is in progress");
+		return;
+	}
+
+	/**
+	 ** Closing waits for everything buffered to be written out.
+	 **/
+	int rc = socket->capture_->Close ();
+	socket->capture_->Stats (&capture_stats);
+	delete socket->capture_;
+	socket->capture_ = NULL;
+
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	Local<Object> stats = Nan::New<Object>();
+	Nan::Set(stats, Nan::New("packets").ToLocalChecked(),
+			Nan::New<Number>((double) capture_stats.packets));
+	Nan::Set(stats, Nan::New("bytes").ToLocalChecked(),
+			Nan::New<Number>((double) capture_stats.bytes));
+	Nan::Set(stats, Nan::New("dropped").ToLocalChecked(),
+			Nan::New<Number>((double) capture_stats.dropped));
+
+	info.GetReturnValue().Set(stats);
+}
+
+NAN_METHOD(SocketWrap::StopReassembly) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+	ReassemblyStats stats;
+
+	if (! socket->reassembler_) {
+		Nan::ThrowError("Reassembly is not enabled");
+		return;
+	}
+
+	/**
+	 ** Fragments still pending are discarded.
+	 **/
+	socket->reassembler_->Stats (&stats);
+	delete socket->reassembler_;
+	socket->reassembler_ = NULL;
+
+	if (socket->reassembly_timer_)
+		uv_timer_stop (socket->reassembly_timer_);
+
+	info.GetReturnValue().Set(ReassemblyObject (stats));
+}
+
+NAN_METHOD(SocketWrap::StopReplay) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+
+	if (socket->replay_)
+		socket->FinishReplay (0);
+
+	info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(SocketWrap::StopScan) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+
+	if (socket->scan_)
+		socket->FinishScan (0);
+
+	info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(SocketWrap::TunName) {
+	Nan::HandleScope scope;
+	
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (info.This ());
+
+	if (socket->tun_)
+		info.GetReturnValue().Set(Nan::New(socket->tun_name_).ToLocalChecked());
+	else
+		info.GetReturnValue().Set(Nan::Null());
+}
+
+void SocketWrap::UpdatePoll (void) {
+	if (this->deconstructing_ || ! this->poll_initialised_)
+		return;
+
+	int events = this->events_;
+
+#ifdef RAW_HAVE_GROUPS
+	/**
+	 ** Members of a group are watched for readability by the group, their
+	 ** own poll handle is only used to wait for the socket to be writeable.
+	 **/
+	if (this->group_) {
+		this->group_->UpdateSocket (this);
+		events &= ~UV_READABLE;
+	}
+#endif
+
+	uv_poll_stop (this->poll_watcher_);
+	if (events)
+		uv_poll_start (this->poll_watcher_, events, IoEvent);
+}
+
+#ifdef RAW_HAVE_GROUPS
+static Nan::Persistent<FunctionTemplate> SocketGroupWrap_constructor;
+
+#define GROUP_EVENTS 256
+#define GROUP_SOCKET_BUDGET 64
+#define GROUP_HARVEST_LIMIT 4096
+
+void SocketGroupWrap::Init (Local<Object> exports) {
+	Nan::HandleScope scope;
+
+	Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(SocketGroupWrap::New);
+	tpl->SetClassName(Nan::New("SocketGroupWrap").ToLocalChecked());
+	tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+	Nan::SetPrototypeMethod(tpl, "add", Add);
+	Nan::SetPrototypeMethod(tpl, "close", Close);
+	Nan::SetPrototypeMethod(tpl, "pause", Pause);
+	Nan::SetPrototypeMethod(tpl, "remove", Remove);
+
+	SocketGroupWrap_constructor.Reset(tpl);
+	Nan::Set(exports, Nan::New("SocketGroupWrap").ToLocalChecked(), Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+SocketGroupWrap::SocketGroupWrap () {
+	epoll_fd_ = -1;
+	poll_watcher_ = NULL;
+	poll_initialised_ = false;
+	buffer_ = NULL;
+	buffer_size_ = 0;
+}
+
+SocketGroupWrap::~SocketGroupWrap () {
+	this->CloseGroup ();
+	delete[] buffer_;
+}
+
+NAN_METHOD(SocketGroupWrap::Add) {
+	Nan::HandleScope scope;
+	
+	SocketGroupWrap* group = SocketGroupWrap::Unwrap<SocketGroupWrap> (info.This ());
+	
+	if (info.Length () < 1) {
+		Nan::ThrowError("One argument is required");
+		return;
+	}
+
+	if (! info[0]->IsObject () || ! Nan::New(SocketWrap_constructor)->HasInstance (info[0])) {
+		Nan::ThrowTypeError("Socket argument must be a SocketWrap object");
+		return;
+	}
+
+	if (! group->poll_initialised_) {
+		Nan::ThrowError("Socket group is closed");
+		return;
+	}
+
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (Nan::To<Object>(info[0]).ToLocalChecked());
+
+	if (socket->group_) {
+		Nan::ThrowError("Socket is already a member of a group");
+		return;
+	}
+
+#ifdef RAW_HAVE_URING
+	if (socket->uring_) {
+		Nan::ThrowError("Sockets using the io_uring engine cannot be added to a group");
+		return;
+	}
+#endif
+
+	int rc = socket->CreateSocket ();
+	if (rc != 0) {
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	uint32_t index;
+	if (group->free_.size ()) {
+		index = group->free_.back ();
+		group->free_.pop_back ();
+	} else {
+		index = (uint32_t) group->sockets_.size ();
+		group->sockets_.push_back (NULL);
+	}
+
+	struct epoll_event event;
+	memset (&event, 0, sizeof (event));
+	event.events = MemberEvents (socket);
+	event.data.u32 = index;
+
+	if (epoll_ctl (group->epoll_fd_, EPOLL_CTL_ADD, socket->poll_fd_, &event) != 0) {
+		group->free_.push_back (index);
+		Nan::ThrowError(raw_strerror (errno));
+		return;
+	}
+
+	group->sockets_[index] = socket;
+	socket->group_ = group;
+	socket->group_index_ = index;
+	socket->UpdatePoll ();
+
+	info.GetReturnValue().Set(Nan::New<Uint32>(index));
+}
+
+NAN_METHOD(SocketGroupWrap::Close) {
+	Nan::HandleScope scope;
+	
+	SocketGroupWrap* group = SocketGroupWrap::Unwrap<SocketGroupWrap> (info.This ());
+	
+	group->CloseGroup ();
+
+	Local<Value> args[1];
+	args[0] = Nan::New<String>("close").ToLocalChecked();
+
+	Nan::Call(Nan::New<String>("emit").ToLocalChecked(), info.This(), 1, args);
+
+	info.GetReturnValue().Set(info.This());
+}
+
+void SocketGroupWrap::CloseGroup (void) {
+	/**
+	 ** Members go back to watching for readability themselves.
+	 **/
+	for (size_t i = 0; i < this->sockets_.size (); i++) {
+		SocketWrap *socket = this->sockets_[i];
+		if (socket) {
+			this->RemoveSocket (socket);
+			socket->UpdatePoll ();
+		}
+	}
+
+	this->sockets_.clear ();
+	this->free_.clear ();
+
+	if (this->poll_initialised_) {
+		uv_close ((uv_handle_t *) this->poll_watcher_, SocketWrap::OnClose);
+		close (this->epoll_fd_);
+		this->epoll_fd_ = -1;
+		this->poll_initialised_ = false;
+	}
+}
+
+void SocketGroupWrap::HandleIOEvent (int status, int revents) {
+	Nan::HandleScope scope;
+
+	if (status) {
+		Local<Value> args[2];
+		args[0] = Nan::New<String>("error").ToLocalChecked();
+
+		char status_str[32];
+		sprintf(status_str, "%d", status);
+		args[1] = Nan::Error(status_str);
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 2, args);
+		return;
+	}
+
+	struct epoll_event events[GROUP_EVENTS];
+	Local<Array> indexes = Nan::New<Array>();
+	Local<Array> buffers = Nan::New<Array>();
+	Local<Array> sources = Nan::New<Array>();
+	std::vector<Local<Object> > failed;
+	std::vector<int> failures;
+#ifdef RAW_HAVE_ERRQUEUE
+	std::vector<Local<Object> > reporting;
+	std::vector<Local<Array> > reports;
+#endif
+	uint32_t received = 0;
+	unsigned int harvested = 0;
+	int count;
+	char addr[50];
+
+	/**
+	 ** Each ready member is drained up to a fixed budget per pass so a busy
+	 ** socket cannot starve the others, the epoll set is level triggered so
+	 ** anything left behind is reported again on the next iteration.
+	 **/
+	do {
+		count = epoll_wait (this->epoll_fd_, events, GROUP_EVENTS, 0);
+		if (count < 0)
+			break;
+
+		for (int i = 0; i < count; i++) {
+			uint32_t index = events[i].data.u32;
+			SocketWrap *socket = index < this->sockets_.size ()
+					? this->sockets_[index]
+					: NULL;
+			/**
+			 ** A member whose receive is paused is left alone, even when
+			 ** an error or hangup is reported for it.
+			 **/
+			if (! socket || ! (socket->events_ & UV_READABLE))
+				continue;
+
+#ifdef RAW_HAVE_ERRQUEUE
+			/**
+			 ** Queued errors must be drained or the level triggered set would
+			 ** keep reporting the socket, doing so also clears the pending
+			 ** error which would otherwise fail the next receive.
+			 **/
+			if ((events[i].events & EPOLLERR) && socket->recv_errors_) {
+				Local<Array> errors = Nan::New<Array>();
+				uint32_t error_count = 0;
+
+				socket->ReadErrors (errors, &error_count);
+				if (error_count) {
+					reporting.push_back (socket->handle ());
+					reports.push_back (errors);
+				}
+			}
+#endif
+
+			for (unsigned int j = 0; j < GROUP_SOCKET_BUDGET; j++) {
+				struct sockaddr_storage from;
+
+				int rc = socket->RecvPacket (this->buffer_,
+						this->buffer_size_, &from);
+
+				if (rc == SOCKET_ERROR) {
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						failed.push_back (socket->handle ());
+						failures.push_back (errno);
+					}
+					break;
+				}
+
+				if (from.ss_family == AF_INET6)
+					uv_ip6_name ((sockaddr_in6 *) &from, addr, 50);
+				else
+					uv_ip4_name ((sockaddr_in *) &from, addr, 50);
+
+				if (socket->capture_)
+					socket->CaptureIn (this->buffer_, rc, (sockaddr *) &from);
+
+				const char *datagram;
+				size_t datagram_length;
+
+				if (! socket->Reassemble (this->buffer_, rc, &datagram,
+						&datagram_length)
+						|| socket->ScanReply (datagram, datagram_length,
+								(sockaddr *) &from))
+					continue;
+
+				Nan::Set(indexes, received, Nan::New<Uint32>(index));
+				Nan::Set(buffers, received, Nan::CopyBuffer(datagram,
+						(uint32_t) datagram_length).ToLocalChecked());
+				Nan::Set(sources, received, Nan::New(addr).ToLocalChecked());
+				received++;
+			}
+		}
+
+		harvested += count;
+	} while (count == GROUP_EVENTS && harvested < GROUP_HARVEST_LIMIT);
+
+	if (received) {
+		Local<Value> args[4];
+		args[0] = Nan::New<String>("recvBatch").ToLocalChecked();
+		args[1] = indexes;
+		args[2] = buffers;
+		args[3] = sources;
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), handle(), 4, args);
+	}
+
+#ifdef RAW_HAVE_ERRQUEUE
+	for (size_t i = 0; i < reporting.size (); i++)
+		SocketWrap::Unwrap<SocketWrap> (reporting[i])->EmitErrors (reports[i]);
+#endif
+
+	/**
+	 ** Receive errors are reported by the member itself, as they would be
+	 ** were it not part of a group.
+	 **/
+	for (size_t i = 0; i < failed.size (); i++) {
+		Local<Value> args[2];
+		args[0] = Nan::New<String>("error").ToLocalChecked();
+		args[1] = Nan::Error(raw_strerror (failures[i]));
+
+		Nan::Call(Nan::New<String>("emit").ToLocalChecked(), failed[i], 2, args);
+	}
+}
+
+/**
+ ** Errors and hangups are always reported by epoll, so a member whose
+ ** receive is paused is watched one shot, and is reported at most once
+ ** until it is resumed instead of on every pass.
+ **/
+uint32_t SocketGroupWrap::MemberEvents (SocketWrap *socket) {
+	if (socket->events_ & UV_READABLE)
+		return EPOLLIN;
+	else
+		return EPOLLONESHOT;
+}
+
+NAN_METHOD(SocketGroupWrap::New) {
+	Nan::HandleScope scope;
+	
+	SocketGroupWrap* group = new SocketGroupWrap ();
+	uint32_t buffer_size = 4096;
+
+	if (info.Length () > 0) {
+		if (! info[0]->IsUint32 ()) {
+			Nan::ThrowTypeError("Buffer size argument must be an unsigned integer");
+			return;
+		}
+		buffer_size = Nan::To<Uint32>(info[0]).ToLocalChecked()->Value();
+	}
+
+	group->epoll_fd_ = epoll_create1 (EPOLL_CLOEXEC);
+	if (group->epoll_fd_ < 0) {
+		int rc = errno;
+		delete group;
+		Nan::ThrowError(raw_strerror (rc));
+		return;
+	}
+
+	group->buffer_size_ = buffer_size;
+	group->buffer_ = new char[buffer_size];
+
+	group->poll_watcher_ = new uv_poll_t;
+	uv_poll_init (uv_default_loop (), group->poll_watcher_, group->epoll_fd_);
+	group->poll_watcher_->data = group;
+	uv_poll_start (group->poll_watcher_, UV_READABLE, GroupIoEvent);
+	group->poll_initialised_ = true;
+
+	group->Wrap (info.This ());
+
+	info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(SocketGroupWrap::Pause) {
+	Nan::HandleScope scope;
+	
+	SocketGroupWrap* group = SocketGroupWrap::Unwrap<SocketGroupWrap> (info.This ());
+
+	if (info.Length () < 1) {
+		Nan::ThrowError("One argument is required");
+		return;
+	}
+	
+	if (! info[0]->IsBoolean ()) {
+		Nan::ThrowTypeError("Recv argument must be a boolean");
+		return;
+	}
+	bool pause_recv = Nan::To<Boolean>(info[0]).ToLocalChecked()->Value();
+
+	if (group->poll_initialised_) {
+		uv_poll_stop (group->poll_watcher_);
+		if (! pause_recv)
+			uv_poll_start (group->poll_watcher_, UV_READABLE, GroupIoEvent);
+	}
+	
+	info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(SocketGroupWrap::Remove) {
+	Nan::HandleScope scope;
+	
+	SocketGroupWrap* group = SocketGroupWrap::Unwrap<SocketGroupWrap> (info.This ());
+	
+	if (info.Length () < 1) {
+		Nan::ThrowError("One argument is required");
+		return;
+	}
+
+	if (! info[0]->IsObject () || ! Nan::New(SocketWrap_constructor)->HasInstance (info[0])) {
+		Nan::ThrowTypeError("Socket argument must be a SocketWrap object");
+		return;
+	}
+
+	SocketWrap* socket = SocketWrap::Unwrap<SocketWrap> (Nan::To<Object>(info[0]).ToLocalChecked());
+
+	if (socket->group_ == group) {
+		group->RemoveSocket (socket);
+		socket->UpdatePoll ();
+	}
+
+	info.GetReturnValue().Set(info.This());
+}
+
+void SocketGroupWrap::RemoveSocket (SocketWrap *socket) {
+	if (this->epoll_fd_ >= 0)
+		epoll_ctl (this->epoll_fd_, EPOLL_CTL_DEL, socket->poll_fd_, NULL);
+
+	if (socket->group_index_ < this->sockets_.size ()
+			&& this->sockets_[socket->group_index_] == socket) {
+		this->sockets_[socket->group_index_] = NULL;
+		this->free_.push_back (socket->group_index_);
+	}
+
+	socket->group_ = NULL;
+}
+
+void SocketGroupWrap::UpdateSocket (SocketWrap *socket) {
+	struct epoll_event event;
+	memset (&event, 0, sizeof (event));
+	event.events = MemberEvents (socket);
+	event.data.u32 = socket->group_index_;
+
+	epoll_ctl (this->epoll_fd_, EPOLL_CTL_MOD, socket->poll_fd_, &event);
+}
+
+static void GroupIoEvent (uv_poll_t* watcher, int status, int revents) {
+	SocketGroupWrap *group = static_cast<SocketGroupWrap*>(watcher->data);
+	group->HandleIOEvent (status, revents);
+}
+#endif
+
+static void ReassemblyEvent (uv_timer_t* timer) {
+	SocketWrap *socket = static_cast<SocketWrap*>(timer->data);
+	socket->HandleReassembly ();
+}
+
+static void ReplayEvent (uv_timer_t* timer) {
+	SocketWrap *socket = static_cast<SocketWrap*>(timer->data);
+	socket->HandleReplay ();
+}
+
+static void ScanEvent (uv_timer_t* timer) {
+	SocketWrap *socket = static_cast<SocketWrap*>(timer->data);
+	socket->HandleScan ();
+}
+
 static void IoEvent (uv_poll_t* watcher, int status, int revents) {
 	SocketWrap *socket = static_cast<SocketWrap*>(watcher->data);
 	socket->HandleIOEvent (status, revents);
@@ -17,6 +17,7 @@
 #endif
 
 #include <string>
+#include <vector>
 
 #include <node.h>
 #include <node_buffer.h>
@@ -28,11 +29,15 @@
 #define SOCKET_ERRNO WSAGetLastError()
 #define SOCKET_OPT_TYPE char *
 #define SOCKET_LEN_TYPE int
+#define SOCKET_IOV_TYPE WSABUF
+#define SOCKET_IOV_BASE(iov) (iov).buf
+#define SOCKET_IOV_LEN(iov) (iov).len
 #else
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -43,12 +48,34 @@
 #define closesocket close
 #define SOCKET_OPT_TYPE void *
 #define SOCKET_LEN_TYPE socklen_t
+#define SOCKET_IOV_TYPE struct iovec
+#define SOCKET_IOV_BASE(iov) (iov).iov_base
+#define SOCKET_IOV_LEN(iov) (iov).iov_len
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/errqueue.h>
+#include <linux/if_tun.h>
+#define RAW_HAVE_GROUPS 1
+#define RAW_HAVE_ERRQUEUE 1
+#define RAW_HAVE_TUN 1
+#endif
+
+#include "capture.h"
+#include "reassembly.h"
+#include "scan.h"
+#include "uring.h"
+
 using namespace v8;
 
 namespace raw {
 
+#define ENGINE_POLL 0
+#define ENGINE_URING 1
+
 NAN_METHOD(CreateChecksum);
 
 void ExportConstants (Local<Object> target);
@@ -59,45 +86,257 @@ NAN_METHOD(Htons);
 NAN_METHOD(Ntohl);
 NAN_METHOD(Ntohs);
 
+#ifdef RAW_HAVE_URING
+struct UringBatch {
+	Nan::Callback callback;
+	std::vector<int> results;
+	unsigned int remaining;
+};
+
+/**
+ ** Everything the kernel reads when it performs a queued sendmsg must stay
+ ** put until the send completes, including the callers buffers.
+ **/
+struct UringSend {
+	struct msghdr message;
+	std::vector<struct iovec> iov;
+	struct sockaddr_storage address;
+	Nan::Persistent<Object> buffer;
+	UringBatch *batch;
+	unsigned int index;
+};
+#endif
+
+/**
+ ** State for a replay in progress, packets are read from the file as they
+ ** become due and sent from a timer on the event loop.
+ **/
+struct ReplayState {
+	CaptureReader reader;
+	CapturePacket packet;
+	bool pending;
+	bool started;
+	uv_timer_t *timer;
+	Nan::Callback callback;
+	double rate;
+	uint64_t base;
+	uint64_t start;
+	bool override;
+	struct sockaddr_storage address;
+	SOCKET_LEN_TYPE address_length;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t skipped;
+	uint64_t errors;
+};
+
+/**
+ ** State for a scan in progress, probes are sent from a timer on the event
+ ** loop and validated replies are collected until the timer next runs.
+ **/
+struct ScanState {
+	SynScanner scanner;
+	std::vector<struct sockaddr_storage> targets;
+	std::vector<uint16_t> ports;
+	uint64_t next;
+	uint64_t total;
+	double rate;
+	uint64_t start;
+	uint64_t wait;
+	uint64_t deadline;
+	bool sending;
+	bool restore;
+	int checksum_offset;
+	uv_timer_t *timer;
+	Nan::Callback callback;
+	std::vector<char> buffer;
+	std::vector<ScanResult> results;
+	uint64_t sent;
+	uint64_t errors;
+	uint64_t open;
+	uint64_t closed;
+};
+
+class SocketGroupWrap;
+
 class SocketWrap : public Nan::ObjectWrap {
+	friend class SocketGroupWrap;
+
 public:
 	void HandleIOEvent (int status, int revents);
+	void HandleReassembly (void);
+	void HandleReplay (void);
+	void HandleScan (void);
 	static void Init (Local<Object> exports);
 
 private:
 	SocketWrap ();
 	~SocketWrap ();
 
+	void CaptureIn (const char *data, size_t length,
+			const struct sockaddr *source);
+	void CaptureOut (const char *data, size_t length,
+			const struct sockaddr *destination);
+	void CaptureSegments (const std::vector<SOCKET_IOV_TYPE> &iov,
+			const struct sockaddr *destination);
+
 	static NAN_METHOD(Close);
 
 	void CloseSocket (void);
 	
 	int CreateSocket (void);
 
+	void EmitScanResults (std::vector<ScanResult> &results);
+
+	static NAN_METHOD(Engine);
 	static NAN_METHOD(GetOption);
+	static NAN_METHOD(GetReassemblyStats);
+
+	void FinishReplay (int rc);
+	void FinishScan (int rc);
+
+	void HandleScanRecv (void);
 
 	static NAN_METHOD(New);
 
 	static void OnClose (uv_handle_t *handle);
 
 	static NAN_METHOD(Pause);
+
+	bool Reassemble (const char *data, size_t length, const char **datagram,
+			size_t *datagram_length);
+
 	static NAN_METHOD(Recv);
+
+	int RecvPacket (char *data, size_t length,
+			struct sockaddr_storage *from);
+
+	static NAN_METHOD(Replay);
+	static NAN_METHOD(Scan);
+
+	bool ScanReply (const char *data, size_t length,
+			const struct sockaddr *from);
+
 	static NAN_METHOD(Send);
+	static NAN_METHOD(SendBatch);
+
+	int SendSegments (std::vector<SOCKET_IOV_TYPE> &iov,
+			struct sockaddr *address, SOCKET_LEN_TYPE address_length);
+
 	static NAN_METHOD(SetOption);
+	static NAN_METHOD(StartCapture);
+	static NAN_METHOD(StartReassembly);
+	static NAN_METHOD(StopCapture);
+	static NAN_METHOD(StopReassembly);
+	static NAN_METHOD(StopReplay);
+	static NAN_METHOD(StopScan);
+	static NAN_METHOD(TunName);
+
+	void UpdatePoll (void);
+
+#ifdef RAW_HAVE_ERRQUEUE
+	void EmitErrors (Local<Array> errors);
+	int ReadErrors (Local<Array> errors, uint32_t *count);
+	int SetRecvErrors (bool enable);
+#endif
+
+#ifdef RAW_HAVE_URING
+	int CreateUring (void);
+	void CloseUring (void);
+	void HandleUringEvent (void);
+	void UpdateUringPoll (void);
+#endif
 
 	bool no_ip_header_;
 
 	uint32_t family_;
 	uint32_t protocol_;
+	uint32_t engine_;
+	uint32_t buffer_size_;
+	bool recv_errors_;
+	bool header_included_;
+
+	/**
+	 ** When tun_ is set the descriptor is a queue of the named TUN device
+	 ** instead of a raw socket, and data is always a complete IP packet.
+	 **/
+	bool tun_;
+	std::string tun_name_;
 
 	SOCKET poll_fd_;
 	uv_poll_t *poll_watcher_;
 	bool poll_initialised_;
+	int events_;
 	
 	bool deconstructing_;
+
+	SocketGroupWrap *group_;
+	uint32_t group_index_;
+
+	CaptureWriter *capture_;
+	bool capture_sent_;
+
+	ReplayState *replay_;
+	ScanState *scan_;
+
+	Reassembler *reassembler_;
+	uv_timer_t *reassembly_timer_;
+
+#ifdef RAW_HAVE_URING
+	UringEngine *uring_;
+	bool uring_recv_;
+	bool uring_polling_;
+	std::vector<UringSend *> uring_sends_;
+	std::vector<uint32_t> uring_free_;
+	unsigned int uring_in_flight_;
+#endif
 };
 
+#ifdef RAW_HAVE_GROUPS
+/**
+ ** A socket group watches many sockets using one epoll set, which is itself
+ ** watched by a single poll handle, and delivers packets received by any
+ ** member in one batch per event loop iteration.
+ **/
+class SocketGroupWrap : public Nan::ObjectWrap {
+public:
+	void HandleIOEvent (int status, int revents);
+	static void Init (Local<Object> exports);
+
+	void RemoveSocket (SocketWrap *socket);
+	void UpdateSocket (SocketWrap *socket);
+
+private:
+	SocketGroupWrap ();
+	~SocketGroupWrap ();
+
+	static NAN_METHOD(Add);
+	static NAN_METHOD(Close);
+	static NAN_METHOD(New);
+	static NAN_METHOD(Pause);
+	static NAN_METHOD(Remove);
+
+	void CloseGroup (void);
+	static uint32_t MemberEvents (SocketWrap *socket);
+
+	int epoll_fd_;
+	uv_poll_t *poll_watcher_;
+	bool poll_initialised_;
+
+	char *buffer_;
+	uint32_t buffer_size_;
+
+	std::vector<SocketWrap *> sockets_;
+	std::vector<uint32_t> free_;
+};
+
+static void GroupIoEvent (uv_poll_t* watcher, int status, int revents);
+#endif
+
 static void IoEvent (uv_poll_t* watcher, int status, int revents);
+static void ReassemblyEvent (uv_timer_t* timer);
+static void ReplayEvent (uv_timer_t* timer);
+static void ScanEvent (uv_timer_t* timer);
 
 }; /* namespace raw */
 
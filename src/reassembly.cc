@@ -0,0 +1,414 @@
+#ifndef REASSEMBLY_CC
+#define REASSEMBLY_CC
+
+#include <string.h>
+
+#include "checksum.h"
+#include "reassembly.h"
+
+namespace raw {
+
+#define IPV4_MORE_FRAGMENTS 0x2000
+#define IPV4_OFFSET_MASK 0x1fff
+
+#define IPV6_HOP_BY_HOP 0
+#define IPV6_ROUTING 43
+#define IPV6_FRAGMENT 44
+#define IPV6_DESTINATION 60
+
+/**
+ ** Neither family allows a datagram to grow beyond this, anything claiming to
+ ** is discarded rather than allocated for.
+ **/
+#define REASSEMBLY_MAX_LENGTH 65535
+
+static uint16_t Get16 (const char *data) {
+	return (uint16_t) (((uint8_t) data[0] << 8) | (uint8_t) data[1]);
+}
+
+static uint32_t Get32 (const char *data) {
+	return ((uint32_t) Get16 (data) << 16) | Get16 (data + 2);
+}
+
+static void Put16 (char *data, uint16_t value) {
+	data[0] = (char) (value >> 8);
+	data[1] = (char) (value & 0xff);
+}
+
+bool ReassemblyKey::operator== (const ReassemblyKey &other) const {
+	return memcmp (this, &other, sizeof (*this)) == 0;
+}
+
+size_t ReassemblyKeyHash::operator() (const ReassemblyKey &key) const {
+	const uint8_t *data = (const uint8_t *) &key;
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < sizeof (key); i++) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+Reassembler::Reassembler (size_t memory_limit, uint64_t timeout) {
+	memory_limit_ = memory_limit;
+	timeout_ = timeout;
+	current_ = 0;
+	started_ = false;
+
+	/**
+	 ** Slots are sized so a datagram never expires more than a full turn of
+	 ** the wheel ahead, allowing one slot for the tick in progress and one
+	 ** for rounding.
+	 **/
+	tick_ = (timeout + REASSEMBLY_SLOTS - 3) / (REASSEMBLY_SLOTS - 2);
+	if (tick_ < 1)
+		tick_ = 1;
+
+	wheel_.resize (REASSEMBLY_SLOTS);
+	memset (&stats_, 0, sizeof (stats_));
+}
+
+Reassembler::~Reassembler () {
+	this->Clear ();
+}
+
+bool Reassembler::Add (const char *data, size_t length, uint64_t now,
+		const char **datagram, size_t *datagram_length) {
+	ReassemblyKey key;
+	bool complete;
+
+	this->Expire (now);
+
+	*datagram = data;
+	*datagram_length = length;
+
+	if (length < 1)
+		return true;
+
+	memset (&key, 0, sizeof (key));
+
+	if (((uint8_t) data[0] >> 4) == 4) {
+		size_t header_length = (data[0] & 0x0f) * 4;
+		if (length < 20 || header_length < 20 || header_length > length)
+			return true;
+
+		uint16_t field = Get16 (data + 6);
+		bool more = (field & IPV4_MORE_FRAGMENTS) != 0;
+		uint32_t offset = (field & IPV4_OFFSET_MASK) * 8;
+
+		if (! more && offset == 0)
+			return true;
+
+		this->stats_.fragments++;
+
+		size_t total_length = Get16 (data + 2);
+		if (total_length < header_length || total_length > length) {
+			this->stats_.invalid++;
+			return false;
+		}
+
+		size_t fragment_length = total_length - header_length;
+		if ((more && (fragment_length == 0 || fragment_length % 8))
+				|| header_length + offset + fragment_length
+						> REASSEMBLY_MAX_LENGTH) {
+			this->stats_.invalid++;
+			return false;
+		}
+
+		key.version = 4;
+		key.protocol = (uint8_t) data[9];
+		memcpy (key.source, data + 12, 4);
+		memcpy (key.destination, data + 16, 4);
+		key.identification = Get16 (data + 4);
+
+		complete = this->AddFragment (key, data, header_length, 0, 0,
+				data + header_length, fragment_length, offset, more, now);
+	} else if (((uint8_t) data[0] >> 4) == 6) {
+		if (length < 40)
+			return true;
+
+		/**
+		 ** The fragment header follows any hop-by-hop, routing and
+		 ** destination options headers, which are part of the headers of
+		 ** the reassembled datagram.
+		 **/
+		size_t end = 40 + Get16 (data + 4);
+		size_t next_header_offset = 6;
+		uint8_t next_header = (uint8_t) data[6];
+		size_t offset = 40;
+
+		if (end > length)
+			return true;
+
+		while (next_header == IPV6_HOP_BY_HOP || next_header == IPV6_ROUTING
+				|| next_header == IPV6_DESTINATION) {
+			if (offset + 8 > end)
+				return true;
+			next_header_offset = offset;
+			next_header = (uint8_t) data[offset];
+			offset += ((uint8_t) data[offset + 1] + 1) * 8;
+		}
+
+		if (next_header != IPV6_FRAGMENT || offset + 8 > end)
+			return true;
+
+		this->stats_.fragments++;
+
+		uint16_t field = Get16 (data + offset + 2);
+		bool more = (field & 1) != 0;
+		uint32_t fragment_offset = field & 0xfff8;
+		size_t fragment_length = end - (offset + 8);
+
+		if ((more && (fragment_length == 0 || fragment_length % 8))
+				|| offset - 40 + fragment_offset + fragment_length
+						> REASSEMBLY_MAX_LENGTH) {
+			this->stats_.invalid++;
+			return false;
+		}
+
+		key.version = 6;
+		memcpy (key.source, data + 8, 16);
+		memcpy (key.destination, data + 24, 16);
+		key.identification = Get32 (data + offset + 4);
+
+		complete = this->AddFragment (key, data, offset, next_header_offset,
+				(uint8_t) data[offset], data + offset + 8, fragment_length,
+				fragment_offset, more, now);
+	} else {
+		return true;
+	}
+
+	if (! complete)
+		return false;
+
+	*datagram = &this->output_[0];
+	*datagram_length = this->output_.size ();
+
+	return true;
+}
+
+/**
+ ** Fragments repeating data already received are ignored, but any other
+ ** overlap discards the whole datagram, as RFC 5722 requires for IPv6 and
+ ** most stacks now do for IPv4, since overlaps are only ever seen in attempts
+ ** to evade inspection.
+ **/
+bool Reassembler::AddFragment (const ReassemblyKey &key, const char *header,
+		size_t header_length, size_t next_header_offset, uint8_t next_header,
+		const char *data, size_t length, uint32_t offset, bool more,
+		uint64_t now) {
+	ReassemblyFlow *flow;
+	uint32_t end = offset + (uint32_t) length;
+
+	std::unordered_map<ReassemblyKey, ReassemblyFlow *,
+			ReassemblyKeyHash>::iterator found = this->flows_.find (key);
+
+	if (found == this->flows_.end ()) {
+		flow = new ReassemblyFlow ();
+		flow->key = key;
+		flow->expires = now + this->timeout_;
+		flow->slot = (unsigned int) ((flow->expires / this->tick_)
+				% REASSEMBLY_SLOTS);
+		flow->position = this->wheel_[flow->slot].insert (
+				this->wheel_[flow->slot].end (), flow);
+		flow->next_header_offset = 0;
+		flow->next_header = 0;
+		flow->total = 0;
+		flow->last = false;
+		flow->memory = sizeof (ReassemblyFlow);
+
+		this->stats_.memory += flow->memory;
+		this->flows_[key] = flow;
+	} else {
+		flow = found->second;
+	}
+
+	if (! more) {
+		if ((flow->last && end != flow->total)
+				|| (flow->ranges.size () && flow->ranges.back ().second > end)) {
+			this->stats_.invalid++;
+			this->Remove (flow);
+			return false;
+		}
+		flow->last = true;
+		flow->total = end;
+	} else if (flow->last && end > flow->total) {
+		this->stats_.invalid++;
+		this->Remove (flow);
+		return false;
+	}
+
+	size_t index = 0;
+	while (index < flow->ranges.size ()
+			&& flow->ranges[index].second < offset)
+		index++;
+
+	for (size_t i = index; i < flow->ranges.size ()
+			&& flow->ranges[i].first < end; i++) {
+		if (offset < flow->ranges[i].second) {
+			if (offset >= flow->ranges[i].first
+					&& end <= flow->ranges[i].second)
+				return false;
+
+			this->stats_.overlaps++;
+			this->Remove (flow);
+			return false;
+		}
+	}
+
+	this->Reserve (flow, end);
+	if (length)
+		memcpy (&flow->data[offset], data, length);
+
+	if (offset == 0) {
+		size_t capacity = flow->header.capacity ();
+		flow->header.assign (header, header + header_length);
+		flow->next_header_offset = next_header_offset;
+		flow->next_header = next_header;
+		flow->memory += flow->header.capacity () - capacity;
+		this->stats_.memory += flow->header.capacity () - capacity;
+	}
+
+	/**
+	 ** Ranges which touch are merged, so a complete datagram is left with a
+	 ** single range covering all of it.
+	 **/
+	std::pair<uint32_t, uint32_t> range (offset, end);
+	if (index < flow->ranges.size ()
+			&& flow->ranges[index].second == offset) {
+		flow->ranges[index].second = end;
+	} else {
+		flow->ranges.insert (flow->ranges.begin () + index, range);
+	}
+	if (index + 1 < flow->ranges.size ()
+			&& flow->ranges[index + 1].first == flow->ranges[index].second) {
+		flow->ranges[index].second = flow->ranges[index + 1].second;
+		flow->ranges.erase (flow->ranges.begin () + index + 1);
+	}
+
+	if (flow->last && flow->ranges.size () == 1
+			&& flow->ranges[0].first == 0
+			&& flow->ranges[0].second == flow->total)
+		return this->Complete (flow);
+
+	/**
+	 ** Make room by evicting the datagrams closest to expiring, which is
+	 ** the front of the first slot in use from the current tick onwards.
+	 **/
+	while (this->stats_.memory > this->memory_limit_ && this->flows_.size ()) {
+		ReassemblyFlow *oldest = NULL;
+
+		for (unsigned int i = 0; i < REASSEMBLY_SLOTS && ! oldest; i++) {
+			std::list<ReassemblyFlow *> *slot = &this->wheel_[
+					(this->current_ + i) % REASSEMBLY_SLOTS];
+			if (slot->size ())
+				oldest = slot->front ();
+		}
+
+		if (! oldest)
+			break;
+
+		this->stats_.evictions++;
+		this->Remove (oldest);
+
+		if (oldest == flow)
+			break;
+	}
+
+	return false;
+}
+
+void Reassembler::Clear (void) {
+	while (this->flows_.size ())
+		this->Remove (this->flows_.begin ()->second);
+}
+
+bool Reassembler::Complete (ReassemblyFlow *flow) {
+	this->output_.assign (flow->header.begin (), flow->header.end ());
+	this->output_.insert (this->output_.end (), flow->data.begin (),
+			flow->data.begin () + flow->total);
+
+	char *header = &this->output_[0];
+
+	if (flow->key.version == 4) {
+		/**
+		 ** Only the don't fragment flag is kept.
+		 **/
+		Put16 (header + 2, (uint16_t) this->output_.size ());
+		Put16 (header + 6, Get16 (header + 6) & 0x4000);
+		Put16 (header + 10, 0);
+		Put16 (header + 10, checksum (0, (unsigned char *) header,
+				flow->header.size ()));
+	} else {
+		header[flow->next_header_offset] = (char) flow->next_header;
+		Put16 (header + 4, (uint16_t) (this->output_.size () - 40));
+	}
+
+	this->stats_.datagrams++;
+	this->Remove (flow);
+
+	return true;
+}
+
+/**
+ ** Ticks are only processed once they have passed in full, so everything in
+ ** a slot has expired by the time it is reached.
+ **/
+void Reassembler::Expire (uint64_t now) {
+	uint64_t target = now / this->tick_;
+
+	if (! this->started_) {
+		this->current_ = target;
+		this->started_ = true;
+		return;
+	}
+
+	if (target > this->current_ + REASSEMBLY_SLOTS)
+		this->current_ = target - REASSEMBLY_SLOTS;
+
+	while (this->current_ < target) {
+		std::list<ReassemblyFlow *> *slot = &this->wheel_[
+				this->current_ % REASSEMBLY_SLOTS];
+
+		while (slot->size ()) {
+			this->stats_.timeouts++;
+			this->Remove (slot->front ());
+		}
+
+		this->current_++;
+	}
+}
+
+void Reassembler::Remove (ReassemblyFlow *flow) {
+	this->wheel_[flow->slot].erase (flow->position);
+	this->flows_.erase (flow->key);
+	this->stats_.memory -= flow->memory;
+	delete flow;
+}
+
+/**
+ ** The buffer grows to fit the fragments received, once the final fragment
+ ** has been seen it is sized for the whole datagram in one go.
+ **/
+void Reassembler::Reserve (ReassemblyFlow *flow, size_t length) {
+	size_t capacity = flow->data.capacity ();
+
+	if (flow->last)
+		flow->data.reserve (flow->total);
+	if (flow->data.size () < length)
+		flow->data.resize (length);
+
+	flow->memory += flow->data.capacity () - capacity;
+	this->stats_.memory += flow->data.capacity () - capacity;
+}
+
+void Reassembler::Stats (ReassemblyStats *stats) {
+	*stats = this->stats_;
+	stats->pending = this->flows_.size ();
+}
+
+}; /* namespace raw */
+
+#endif /* REASSEMBLY_CC */
@@ -0,0 +1,132 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+/**
+ ** Reassembly of IPv4 and IPv6 fragments, so that only complete datagrams
+ ** are passed to JavaScript.
+ **
+ ** Each datagram being reassembled has a buffer of its own which fragments
+ ** are copied into at their offset, the memory used by all of them together
+ ** is bounded, and when the bound is reached the oldest are evicted.  Each is
+ ** also given a fixed time to complete, kept track of using a timer wheel so
+ ** expiring them costs nothing per packet.  Like the capture classes this
+ ** knows nothing about node or V8, the SocketWrap class drives it.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace raw {
+
+#define REASSEMBLY_SLOTS 64
+
+struct ReassemblyStats {
+	uint64_t fragments;
+	uint64_t datagrams;
+	uint64_t timeouts;
+	uint64_t evictions;
+	uint64_t overlaps;
+	uint64_t invalid;
+	uint64_t pending;
+	uint64_t memory;
+};
+
+/**
+ ** Fragments belong to the same datagram when they share the addresses and
+ ** identification, and for IPv4 the protocol.  Keys are compared byte by
+ ** byte, so they are always zeroed before being filled in.
+ **/
+struct ReassemblyKey {
+	uint8_t version;
+	uint8_t protocol;
+	uint8_t source[16];
+	uint8_t destination[16];
+	uint32_t identification;
+
+	bool operator== (const ReassemblyKey &other) const;
+};
+
+struct ReassemblyKeyHash {
+	size_t operator() (const ReassemblyKey &key) const;
+};
+
+struct ReassemblyFlow {
+	ReassemblyKey key;
+	uint64_t expires;
+	unsigned int slot;
+	std::list<ReassemblyFlow *>::iterator position;
+
+	/**
+	 ** The headers of the first fragment, i.e. everything which precedes the
+	 ** fragmentable part, and for IPv6 where in them the next header field
+	 ** which named the fragment header is.
+	 **/
+	std::vector<char> header;
+	size_t next_header_offset;
+	uint8_t next_header;
+
+	/**
+	 ** Fragment data at its offset, and the ranges received so far which
+	 ** are kept sorted and merged when they touch.
+	 **/
+	std::vector<char> data;
+	std::vector<std::pair<uint32_t, uint32_t> > ranges;
+	uint32_t total;
+	bool last;
+
+	size_t memory;
+};
+
+class Reassembler {
+public:
+	Reassembler (size_t memory_limit, uint64_t timeout);
+	~Reassembler ();
+
+	/**
+	 ** Packets must start with their IP header.  Returns true when there is
+	 ** something to deliver, either the packet itself, when it was not a
+	 ** fragment, or a complete datagram which stays valid until the next
+	 ** call.  Times are in milliseconds.
+	 **/
+	bool Add (const char *data, size_t length, uint64_t now,
+			const char **datagram, size_t *datagram_length);
+
+	void Clear (void);
+	void Expire (uint64_t now);
+
+	uint64_t Interval (void) { return tick_; }
+	size_t Pending (void) { return flows_.size (); }
+
+	void Stats (ReassemblyStats *stats);
+
+private:
+	bool AddFragment (const ReassemblyKey &key, const char *header,
+			size_t header_length, size_t next_header_offset,
+			uint8_t next_header, const char *data, size_t length,
+			uint32_t offset, bool more, uint64_t now);
+	bool Complete (ReassemblyFlow *flow);
+	void Remove (ReassemblyFlow *flow);
+	void Reserve (ReassemblyFlow *flow, size_t length);
+
+	size_t memory_limit_;
+	uint64_t timeout_;
+	uint64_t tick_;
+	uint64_t current_;
+	bool started_;
+
+	std::unordered_map<ReassemblyKey, ReassemblyFlow *, ReassemblyKeyHash> flows_;
+	std::vector<std::list<ReassemblyFlow *> > wheel_;
+
+	std::vector<char> output_;
+
+	ReassemblyStats stats_;
+};
+
+}; /* namespace raw */
+
+#endif /* REASSEMBLY_H */
@@ -0,0 +1,315 @@
+#ifndef SCAN_CC
+#define SCAN_CC
+
+#ifdef _WIN32
+#define _CRT_RAND_S
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <uv.h>
+
+#include "checksum.h"
+#include "scan.h"
+
+namespace raw {
+
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+#define TCP_HEADER_LENGTH 24
+#define SCAN_WINDOW 64240
+#define SCAN_MSS 1460
+
+static uint16_t Get16 (const uint8_t *data) {
+	return (uint16_t) ((data[0] << 8) | data[1]);
+}
+
+static uint32_t Get32 (const uint8_t *data) {
+	return ((uint32_t) Get16 (data) << 16) | Get16 (data + 2);
+}
+
+static void Put16 (uint8_t *data, uint16_t value) {
+	data[0] = (uint8_t) (value >> 8);
+	data[1] = (uint8_t) (value & 0xff);
+}
+
+static void Put32 (uint8_t *data, uint32_t value) {
+	Put16 (data, (uint16_t) (value >> 16));
+	Put16 (data + 2, (uint16_t) (value & 0xffff));
+}
+
+static uint64_t GetLE64 (const uint8_t *data) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | data[i];
+	return value;
+}
+
+#define ROTL(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+	} while (0)
+
+/**
+ ** SipHash-2-4, which is fast for short inputs and, unlike a plain hash,
+ ** cannot be predicted by a target that does not know the key.
+ **/
+static uint64_t SipHash (const uint8_t *key, const uint8_t *data,
+		size_t length) {
+	uint64_t k0 = GetLE64 (key);
+	uint64_t k1 = GetLE64 (key + 8);
+	uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+	uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+	uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+	uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+	uint64_t m;
+	size_t i;
+
+	for (i = 0; i + 8 <= length; i += 8) {
+		m = GetLE64 (data + i);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	m = (uint64_t) length << 56;
+	for (size_t j = 0; i + j < length; j++)
+		m |= (uint64_t) data[i + j] << (j * 8);
+
+	v3 ^= m;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= m;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ ** Fills the buffer from the system CSPRNG, uv_random() is only available
+ ** from libuv 1.33 onwards.
+ **/
+static int RandomBytes (uint8_t *buffer, size_t length) {
+#if UV_VERSION_MAJOR > 1 || (UV_VERSION_MAJOR == 1 && UV_VERSION_MINOR >= 33)
+	int rc = uv_random (NULL, NULL, buffer, length, 0, NULL);
+	return rc != 0 ? -rc : 0;
+#elif defined(_WIN32)
+	for (size_t i = 0; i < length; i++) {
+		unsigned int value;
+		if (rand_s (&value) != 0)
+			return EIO;
+		buffer[i] = (uint8_t) value;
+	}
+	return 0;
+#else
+	int fd = open ("/dev/urandom", O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	size_t done = 0;
+	while (done < length) {
+		ssize_t rc = read (fd, buffer + done, length - done);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			int error = rc < 0 ? errno : EIO;
+			close (fd);
+			return error;
+		}
+		done += rc;
+	}
+
+	close (fd);
+	return 0;
+#endif
+}
+
+SynScanner::SynScanner () {
+	family_ = AF_INET;
+	source_port_ = 0;
+	template_length_ = 0;
+	invalid_ = 0;
+	memset (key_, 0, sizeof (key_));
+	memset (source_, 0, sizeof (source_));
+	memset (template_, 0, sizeof (template_));
+}
+
+int SynScanner::Open (int family, const struct sockaddr *source,
+		uint16_t source_port, uint8_t ttl) {
+	int rc = RandomBytes (this->key_, sizeof (this->key_));
+	if (rc != 0)
+		return rc;
+
+	this->family_ = family;
+	this->source_port_ = source_port;
+	this->invalid_ = 0;
+
+	uint8_t *packet = (uint8_t *) this->template_;
+	uint8_t *tcp = packet;
+
+	memset (this->template_, 0, sizeof (this->template_));
+
+	/**
+	 ** The kernel fills in the identification and checksum of the IP header
+	 ** when they are left zero.
+	 **/
+	if (family == AF_INET) {
+		memcpy (this->source_, &((struct sockaddr_in *) source)->sin_addr, 4);
+
+		packet[0] = 0x45;
+		Put16 (packet + 2, 20 + TCP_HEADER_LENGTH);
+		packet[8] = ttl;
+		packet[9] = IPPROTO_TCP;
+		memcpy (packet + 12, this->source_, 4);
+
+		tcp = packet + 20;
+		this->template_length_ = 20 + TCP_HEADER_LENGTH;
+	} else {
+		this->template_length_ = TCP_HEADER_LENGTH;
+	}
+
+	Put16 (tcp, source_port);
+	tcp[12] = (TCP_HEADER_LENGTH / 4) << 4;
+	tcp[13] = TCP_SYN;
+	Put16 (tcp + 14, SCAN_WINDOW);
+	tcp[20] = 2;
+	tcp[21] = 4;
+	Put16 (tcp + 22, SCAN_MSS);
+
+	return 0;
+}
+
+uint32_t SynScanner::Cookie (const uint8_t *address, size_t address_length,
+		uint16_t port) {
+	uint8_t data[20];
+
+	memset (data, 0, sizeof (data));
+	memcpy (data, address, address_length);
+	Put16 (data + 16, port);
+	Put16 (data + 18, this->source_port_);
+
+	return (uint32_t) SipHash (this->key_, data, sizeof (data));
+}
+
+size_t SynScanner::Probe (const struct sockaddr *target, uint16_t port,
+		char *packet) {
+	uint8_t *data = (uint8_t *) packet;
+
+	memcpy (packet, this->template_, this->template_length_);
+
+	if (this->family_ == AF_INET) {
+		const uint8_t *address = (const uint8_t *)
+				&((const struct sockaddr_in *) target)->sin_addr;
+		uint8_t *tcp = data + 20;
+		uint8_t pseudo[12];
+
+		memcpy (data + 16, address, 4);
+		Put16 (tcp + 2, port);
+		Put32 (tcp + 4, this->Cookie (address, 4, port));
+
+		memcpy (pseudo, this->source_, 4);
+		memcpy (pseudo + 4, address, 4);
+		pseudo[8] = 0;
+		pseudo[9] = IPPROTO_TCP;
+		Put16 (pseudo + 10, TCP_HEADER_LENGTH);
+
+		uint16_t sum = checksum (checksum (0, pseudo, sizeof (pseudo)), tcp,
+				TCP_HEADER_LENGTH);
+		Put16 (tcp + 16, sum);
+	} else {
+		const uint8_t *address = (const uint8_t *)
+				&((const struct sockaddr_in6 *) target)->sin6_addr;
+
+		Put16 (data + 2, port);
+		Put32 (data + 4, this->Cookie (address, 16, port));
+	}
+
+	return this->template_length_;
+}
+
+/**
+ ** An open port answers with a SYN-ACK and a closed port with an RST, both
+ ** acknowledging our sequence number, anything else is not a reply to us.
+ **/
+bool SynScanner::Match (const char *data, size_t length,
+		const struct sockaddr *from, ScanResult *result) {
+	const uint8_t *packet = (const uint8_t *) data;
+	const uint8_t *tcp = packet;
+	const uint8_t *address;
+	size_t address_length;
+
+	memset (result, 0, sizeof (*result));
+
+	if (this->family_ == AF_INET) {
+		if (length < 20 || (packet[0] >> 4) != 4 || packet[9] != IPPROTO_TCP)
+			return false;
+
+		size_t header_length = (packet[0] & 0x0f) * 4;
+		if (header_length < 20 || length < header_length + 20)
+			return false;
+
+		tcp = packet + header_length;
+		address = packet + 12;
+		address_length = 4;
+
+		struct sockaddr_in *sin = (struct sockaddr_in *) &result->address;
+		sin->sin_family = AF_INET;
+		memcpy (&sin->sin_addr, address, 4);
+	} else {
+		if (length < 20 || ! from || from->sa_family != AF_INET6)
+			return false;
+
+		address = (const uint8_t *)
+				&((const struct sockaddr_in6 *) from)->sin6_addr;
+		address_length = 16;
+
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &result->address;
+		sin6->sin6_family = AF_INET6;
+		memcpy (&sin6->sin6_addr, address, 16);
+	}
+
+	if (Get16 (tcp + 2) != this->source_port_)
+		return false;
+
+	uint8_t flags = tcp[13];
+	bool open = (flags & (TCP_SYN | TCP_ACK | TCP_RST)) == (TCP_SYN | TCP_ACK);
+	bool closed = (flags & (TCP_SYN | TCP_ACK | TCP_RST)) == (TCP_ACK | TCP_RST);
+
+	if (! open && ! closed)
+		return false;
+
+	uint16_t port = Get16 (tcp);
+	if (Get32 (tcp + 8) - 1 != this->Cookie (address, address_length, port)) {
+		this->invalid_++;
+		return false;
+	}
+
+	result->port = port;
+	result->open = open;
+
+	return true;
+}
+
+}; /* namespace raw */
+
+#endif /* SCAN_CC */
@@ -0,0 +1,78 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/**
+ ** A stateless TCP SYN scanner.  Probes are built from a template, and the
+ ** sequence number of each is a keyed hash of the target address and ports,
+ ** so a SYN-ACK or RST acknowledging it can be validated by computing the
+ ** hash again instead of remembering what was sent.  Like the capture and
+ ** reassembly classes this knows nothing about node or V8, the SocketWrap
+ ** class drives it.
+ **/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <Ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+namespace raw {
+
+/**
+ ** An IPv4 header followed by a TCP header carrying a single MSS option,
+ ** IPv6 probes are sent without the IP header.
+ **/
+#define SCAN_PROBE_LENGTH 44
+
+struct ScanResult {
+	struct sockaddr_storage address;
+	uint16_t port;
+	bool open;
+};
+
+class SynScanner {
+public:
+	SynScanner ();
+
+	/**
+	 ** IPv4 probes include the IP header so the source address must be
+	 ** known, for IPv6 the kernel fills in the header and the checksum.
+	 **/
+	int Open (int family, const struct sockaddr *source, uint16_t source_port,
+			uint8_t ttl);
+
+	size_t Probe (const struct sockaddr *target, uint16_t port, char *packet);
+
+	/**
+	 ** Data starts with the IP header for IPv4, and with the TCP header for
+	 ** IPv6 in which case from is the address the data was received from.
+	 ** Returns true when the data is a valid reply to one of our probes.
+	 **/
+	bool Match (const char *data, size_t length, const struct sockaddr *from,
+			ScanResult *result);
+
+	uint64_t Invalid (void) { return invalid_; }
+
+private:
+	uint32_t Cookie (const uint8_t *address, size_t address_length,
+			uint16_t port);
+
+	int family_;
+	uint8_t key_[16];
+	uint8_t source_[4];
+	uint16_t source_port_;
+
+	char template_[SCAN_PROBE_LENGTH];
+	size_t template_length_;
+
+	uint64_t invalid_;
+};
+
+}; /* namespace raw */
+
+#endif /* SCAN_H */
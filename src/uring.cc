@@ -0,0 +1,538 @@
+#ifndef URING_CC
+#define URING_CC
+
+#include "uring.h"
+
+#ifdef RAW_HAVE_URING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace raw {
+
+#define URING_BUFFER_GROUP 0
+
+/**
+ ** How long to wait, in milliseconds, for each completion while cancelling,
+ ** and how many times to wait without any arriving before giving up.
+ **/
+#define URING_CANCEL_WAIT 100
+#define URING_CANCEL_ATTEMPTS 10
+
+/**
+ ** Space reserved at the front of each provided buffer for the recvmsg
+ ** header and source address the kernel writes ahead of the payload.
+ **/
+#define URING_NAME_LENGTH sizeof (struct sockaddr_in6)
+#define URING_BUFFER_OVERHEAD (sizeof (struct io_uring_recvmsg_out) \
+		+ URING_NAME_LENGTH)
+
+static int uring_setup (unsigned int entries, struct io_uring_params *params) {
+	return (int) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter (int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags) {
+	return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, NULL, 0);
+}
+
+static int uring_wait (int fd, unsigned int milliseconds) {
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+
+	ts.tv_sec = milliseconds / 1000;
+	ts.tv_nsec = (milliseconds % 1000) * 1000000;
+
+	memset (&arg, 0, sizeof (arg));
+	arg.ts = (unsigned long) &ts;
+
+	return (int) syscall (__NR_io_uring_enter, fd, 0, 1,
+			IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof (arg));
+}
+
+static int uring_register (int fd, unsigned int opcode, void *arg,
+		unsigned int count) {
+	return (int) syscall (__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+UringEngine::UringEngine () {
+	fd_ = -1;
+	ring_fd_ = -1;
+	sq_ring_ = MAP_FAILED;
+	sq_ring_size_ = 0;
+	cq_ring_ = MAP_FAILED;
+	cq_ring_size_ = 0;
+	sqes_ = (struct io_uring_sqe *) MAP_FAILED;
+	sqes_size_ = 0;
+	buf_ring_ = (struct io_uring_buf_ring *) MAP_FAILED;
+	buf_ring_size_ = 0;
+	buffers_ = (char *) MAP_FAILED;
+	buffers_size_ = 0;
+	buffer_count_ = 0;
+	buffer_size_ = 0;
+	buf_tail_ = 0;
+	sq_local_tail_ = 0;
+	recv_armed_ = false;
+	recv_wanted_ = false;
+	in_flight_ = 0;
+	memset (&recv_message_, 0, sizeof (recv_message_));
+}
+
+UringEngine::~UringEngine () {
+	this->Close ();
+}
+
+int UringEngine::Open (int fd, unsigned int entries,
+		unsigned int buffer_count, unsigned int buffer_size) {
+	struct io_uring_params params;
+
+	memset (&params, 0, sizeof (params));
+
+	/**
+	 ** IORING_SETUP_SINGLE_ISSUER arrived in the same kernel release as
+	 ** multishot recvmsg, so a kernel which rejects it is too old for us
+	 ** and the caller will fall back to the poll engine.
+	 **/
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL
+			| IORING_SETUP_SINGLE_ISSUER;
+	params.cq_entries = entries * 4;
+
+	ring_fd_ = uring_setup (entries, &params);
+	if (ring_fd_ < 0) {
+		ring_fd_ = -1;
+		return errno;
+	}
+
+	sq_ring_size_ = params.sq_off.array
+			+ params.sq_entries * sizeof (unsigned int);
+	cq_ring_size_ = params.cq_off.cqes
+			+ params.cq_entries * sizeof (struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_ring_size_ > sq_ring_size_)
+			sq_ring_size_ = cq_ring_size_;
+		cq_ring_size_ = 0;
+	}
+
+	sq_ring_ = mmap (NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+	if (sq_ring_ == MAP_FAILED)
+		goto error;
+
+	if (cq_ring_size_) {
+		cq_ring_ = mmap (NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+		if (cq_ring_ == MAP_FAILED)
+			goto error;
+	}
+
+	sqes_size_ = params.sq_entries * sizeof (struct io_uring_sqe);
+	sqes_ = (struct io_uring_sqe *) mmap (NULL, sqes_size_,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+			IORING_OFF_SQES);
+	if (sqes_ == MAP_FAILED)
+		goto error;
+
+	{
+		char *sq = (char *) sq_ring_;
+		char *cq = (char *) (cq_ring_size_ ? cq_ring_ : sq_ring_);
+
+		sq_flags_ = (unsigned int *) (sq + params.sq_off.flags);
+		sq_head_ = (unsigned int *) (sq + params.sq_off.head);
+		sq_tail_ = (unsigned int *) (sq + params.sq_off.tail);
+		sq_array_ = (unsigned int *) (sq + params.sq_off.array);
+		sq_mask_ = *(unsigned int *) (sq + params.sq_off.ring_mask);
+		sq_entries_ = *(unsigned int *) (sq + params.sq_off.ring_entries);
+		sq_local_tail_ = *sq_tail_;
+
+		cq_head_ = (unsigned int *) (cq + params.cq_off.head);
+		cq_tail_ = (unsigned int *) (cq + params.cq_off.tail);
+		cq_mask_ = *(unsigned int *) (cq + params.cq_off.ring_mask);
+		cqes_ = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	}
+
+	/**
+	 ** The provided buffer ring must hold a power of two number of entries,
+	 ** and each buffer must have room for the recvmsg header and the source
+	 ** address as well as the payload.
+	 **/
+	buffer_count_ = 1;
+	while (buffer_count_ < buffer_count && buffer_count_ < 32768)
+		buffer_count_ <<= 1;
+	buffer_size_ = buffer_size + URING_BUFFER_OVERHEAD;
+
+	buf_ring_size_ = buffer_count_ * sizeof (struct io_uring_buf);
+	buf_ring_ = (struct io_uring_buf_ring *) mmap (NULL, buf_ring_size_,
+			PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (buf_ring_ == MAP_FAILED)
+		goto error;
+
+	buffers_size_ = (size_t) buffer_count_ * buffer_size_;
+	buffers_ = (char *) mmap (NULL, buffers_size_, PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (buffers_ == MAP_FAILED)
+		goto error;
+
+	{
+		struct io_uring_buf_reg reg;
+		memset (&reg, 0, sizeof (reg));
+		reg.ring_addr = (unsigned long) buf_ring_;
+		reg.ring_entries = buffer_count_;
+		reg.bgid = URING_BUFFER_GROUP;
+
+		if (uring_register (ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+			goto error;
+	}
+
+	buf_tail_ = 0;
+	for (unsigned short bid = 0; bid < buffer_count_; bid++)
+		released_.push_back (bid);
+
+	fd_ = fd;
+
+	recv_message_.msg_namelen = URING_NAME_LENGTH;
+
+	this->Release ();
+
+	return 0;
+
+error:
+	int rc = errno;
+	this->Close ();
+	return rc;
+}
+
+bool UringEngine::Cancel (void) {
+	if (ring_fd_ < 0)
+		return in_flight_ == 0;
+
+	if (in_flight_ == 0)
+		return true;
+
+	recv_wanted_ = false;
+
+	struct io_uring_sqe *sqe = this->GetSqe ();
+	if (sqe) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		sqe->user_data = URING_TAG_CANCEL;
+		in_flight_++;
+	}
+
+	this->Submit ();
+
+	/**
+	 ** Completions are consumed and thrown away, the caller drops whatever
+	 ** they belonged to.
+	 **/
+	UringCompletion completions[64];
+	unsigned int attempts = 0;
+
+	while (in_flight_ > 0 && attempts < URING_CANCEL_ATTEMPTS) {
+		if (this->Harvest (completions, 64) > 0) {
+			attempts = 0;
+			continue;
+		}
+		if (this->Wait () != 0)
+			attempts++;
+	}
+
+	released_.clear ();
+
+	return in_flight_ == 0;
+}
+
+void UringEngine::Close (void) {
+	/**
+	 ** The kernel may still write into the provided buffers until every
+	 ** request has completed, if that cannot be confirmed they are left
+	 ** mapped, the ring mappings are safe to release either way.
+	 **/
+	bool idle = this->Cancel ();
+
+	if (ring_fd_ >= 0) {
+		close (ring_fd_);
+		ring_fd_ = -1;
+	}
+
+	if (sqes_ != MAP_FAILED)
+		munmap (sqes_, sqes_size_);
+	sqes_ = (struct io_uring_sqe *) MAP_FAILED;
+
+	if (cq_ring_ != MAP_FAILED)
+		munmap (cq_ring_, cq_ring_size_);
+	cq_ring_ = MAP_FAILED;
+
+	if (sq_ring_ != MAP_FAILED)
+		munmap (sq_ring_, sq_ring_size_);
+	sq_ring_ = MAP_FAILED;
+
+	if (buffers_ != MAP_FAILED && idle)
+		munmap (buffers_, buffers_size_);
+	buffers_ = (char *) MAP_FAILED;
+
+	if (buf_ring_ != MAP_FAILED && idle)
+		munmap (buf_ring_, buf_ring_size_);
+	buf_ring_ = (struct io_uring_buf_ring *) MAP_FAILED;
+
+	released_.clear ();
+	recv_armed_ = false;
+	recv_wanted_ = false;
+	in_flight_ = 0;
+	fd_ = -1;
+}
+
+struct io_uring_sqe *UringEngine::GetSqe (void) {
+	unsigned int head = __atomic_load_n (sq_head_, __ATOMIC_ACQUIRE);
+
+	/**
+	 ** When the submission queue is full hand what we have to the kernel,
+	 ** which frees up entries, before giving up.
+	 **/
+	if (sq_local_tail_ - head >= sq_entries_) {
+		this->Submit ();
+		head = __atomic_load_n (sq_head_, __ATOMIC_ACQUIRE);
+		if (sq_local_tail_ - head >= sq_entries_)
+			return NULL;
+	}
+
+	unsigned int index = sq_local_tail_ & sq_mask_;
+	struct io_uring_sqe *sqe = &sqes_[index];
+
+	memset (sqe, 0, sizeof (*sqe));
+	sq_array_[index] = index;
+	sq_local_tail_++;
+
+	return sqe;
+}
+
+int UringEngine::Submit (void) {
+	if (ring_fd_ < 0)
+		return EBADF;
+
+	__atomic_store_n (sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+	unsigned int pending = sq_local_tail_
+			- __atomic_load_n (sq_head_, __ATOMIC_ACQUIRE);
+	if (pending == 0)
+		return 0;
+
+	/**
+	 ** EAGAIN and EBUSY mean the kernel could not take everything right now,
+	 ** entries it did not consume stay queued and go with the next submit.
+	 **/
+	if (uring_enter (ring_fd_, pending, 0, 0) < 0) {
+		if (errno == EAGAIN || errno == EBUSY || errno == EINTR)
+			return 0;
+		return errno;
+	}
+
+	return 0;
+}
+
+/**
+ ** Returns zero once at least one completion is waiting, or when the wait
+ ** was interrupted, otherwise it timed out or failed.
+ **/
+int UringEngine::Wait (void) {
+	if (uring_wait (ring_fd_, URING_CANCEL_WAIT) < 0 && errno != EINTR)
+		return errno;
+
+	unsigned int head = *cq_head_;
+	if (head == __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE)
+			&& ! (__atomic_load_n (sq_flags_, __ATOMIC_RELAXED)
+					& IORING_SQ_CQ_OVERFLOW))
+		return ETIME;
+
+	return 0;
+}
+
+int UringEngine::ArmRecv (void) {
+	struct io_uring_sqe *sqe = this->GetSqe ();
+	if (! sqe)
+		return EBUSY;
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd_;
+	sqe->addr = (unsigned long) &recv_message_;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = URING_TAG_RECV;
+
+	recv_armed_ = true;
+	in_flight_++;
+
+	return 0;
+}
+
+int UringEngine::StartRecv (void) {
+	recv_wanted_ = true;
+
+	if (! recv_armed_) {
+		int rc = this->ArmRecv ();
+		if (rc != 0)
+			return rc;
+	}
+
+	return this->Submit ();
+}
+
+int UringEngine::StopRecv (void) {
+	recv_wanted_ = false;
+
+	if (recv_armed_) {
+		struct io_uring_sqe *sqe = this->GetSqe ();
+		if (! sqe)
+			return EBUSY;
+
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = URING_TAG_RECV;
+		sqe->user_data = URING_TAG_CANCEL;
+		in_flight_++;
+	}
+
+	return this->Submit ();
+}
+
+int UringEngine::QueueSend (uint64_t user_data, struct msghdr *message) {
+	struct io_uring_sqe *sqe = this->GetSqe ();
+	if (! sqe)
+		return EBUSY;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd_;
+	sqe->addr = (unsigned long) message;
+	sqe->len = 1;
+	sqe->user_data = user_data;
+
+	in_flight_++;
+
+	return 0;
+}
+
+unsigned int UringEngine::Harvest (UringCompletion *completions,
+		unsigned int max) {
+	unsigned int head = *cq_head_;
+	unsigned int tail = __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE);
+	unsigned int count = 0;
+
+	/**
+	 ** Completions which did not fit into the completion queue are held by
+	 ** the kernel until we ask for events, so flush them once it is empty.
+	 **/
+	if (head == tail && (__atomic_load_n (sq_flags_, __ATOMIC_RELAXED)
+			& IORING_SQ_CQ_OVERFLOW)) {
+		uring_enter (ring_fd_, 0, 0, IORING_ENTER_GETEVENTS);
+		tail = __atomic_load_n (cq_tail_, __ATOMIC_ACQUIRE);
+	}
+
+	while (head != tail && count < max) {
+		struct io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+		UringCompletion *completion = &completions[count++];
+		head++;
+
+		completion->result = cqe->res;
+		completion->user_data = cqe->user_data;
+		completion->data = NULL;
+		completion->length = 0;
+		completion->name = NULL;
+		completion->name_length = 0;
+		completion->truncated = false;
+
+		if (cqe->user_data == URING_TAG_CANCEL) {
+			completion->type = URING_OTHER;
+			in_flight_--;
+			continue;
+		}
+
+		if (cqe->user_data != URING_TAG_RECV) {
+			completion->type = URING_SEND;
+			in_flight_--;
+			continue;
+		}
+
+		completion->type = URING_RECV;
+
+		/**
+		 ** Without IORING_CQE_F_MORE the multishot request has finished,
+		 ** typically because we ran out of buffers, Release() re-arms it.
+		 **/
+		if (! (cqe->flags & IORING_CQE_F_MORE)) {
+			recv_armed_ = false;
+			in_flight_--;
+		}
+
+		if (! (cqe->flags & IORING_CQE_F_BUFFER))
+			continue;
+
+		unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		released_.push_back (bid);
+
+		if (cqe->res < 0)
+			continue;
+
+		char *buffer = buffers_ + (size_t) bid * buffer_size_;
+		struct io_uring_recvmsg_out *out
+				= (struct io_uring_recvmsg_out *) buffer;
+		size_t available = buffer_size_ - URING_BUFFER_OVERHEAD
+				- recv_message_.msg_controllen;
+
+		completion->name = (const struct sockaddr *) (out + 1);
+		completion->name_length = out->namelen < URING_NAME_LENGTH
+				? out->namelen : URING_NAME_LENGTH;
+		completion->data = buffer + URING_BUFFER_OVERHEAD
+				+ recv_message_.msg_controllen;
+		completion->length = out->payloadlen < available
+				? out->payloadlen : available;
+		completion->truncated = (out->flags & MSG_TRUNC) != 0;
+	}
+
+	__atomic_store_n (cq_head_, head, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+void UringEngine::Release (void) {
+	if (buf_ring_ == MAP_FAILED)
+		return;
+
+	unsigned short mask = (unsigned short) (buffer_count_ - 1);
+
+	/**
+	 ** Index the ring entries by hand, under C++ the kernel headers flexible
+	 ** array member lands after an empty struct and so at the wrong offset.
+	 **/
+	struct io_uring_buf *bufs = (struct io_uring_buf *) buf_ring_;
+
+	for (size_t i = 0; i < released_.size (); i++) {
+		unsigned short bid = released_[i];
+		struct io_uring_buf *buf = &bufs[(buf_tail_ + i) & mask];
+		buf->addr = (unsigned long) (buffers_ + (size_t) bid * buffer_size_);
+		buf->len = buffer_size_;
+		buf->bid = bid;
+	}
+
+	buf_tail_ += (unsigned short) released_.size ();
+	released_.clear ();
+
+	__atomic_store_n (&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+
+	if (recv_wanted_ && ! recv_armed_)
+		this->ArmRecv ();
+
+	this->Submit ();
+}
+
+}; /* namespace raw */
+
+#endif /* RAW_HAVE_URING */
+
+#endif /* URING_CC */
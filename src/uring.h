@@ -0,0 +1,136 @@
+#ifndef URING_H
+#define URING_H
+
+/**
+ ** An io_uring based I/O engine for Linux.  Receives are performed using a
+ ** single multishot recvmsg request whose data lands in a ring of provided
+ ** buffers, and sends are queued as sendmsg requests and submitted together,
+ ** so many packets can be moved per system call and per event loop iteration.
+ **
+ ** The engine knows nothing about node or V8, the SocketWrap class drives it
+ ** and converts its completions into JavaScript values.  It is only compiled
+ ** when the kernel headers describe the features it needs, RAW_HAVE_URING is
+ ** defined when that is the case.
+ **/
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_SETUP_SINGLE_ISSUER)
+#define RAW_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#ifdef RAW_HAVE_URING
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <vector>
+
+namespace raw {
+
+#define URING_TAG_RECV 0xffffffffffffffffULL
+#define URING_TAG_CANCEL 0xfffffffffffffffeULL
+
+enum UringCompletionType {
+	URING_RECV = 0,
+	URING_SEND = 1,
+	URING_OTHER = 2
+};
+
+/**
+ ** For receive completions data and name point into a provided buffer, they
+ ** stay valid until Release() is called.
+ **/
+struct UringCompletion {
+	int type;
+	int result;
+	uint64_t user_data;
+	const char *data;
+	size_t length;
+	const struct sockaddr *name;
+	socklen_t name_length;
+	bool truncated;
+};
+
+class UringEngine {
+public:
+	UringEngine ();
+	~UringEngine ();
+
+	int Open (int fd, unsigned int entries, unsigned int buffer_count,
+			unsigned int buffer_size);
+	void Close (void);
+
+	/**
+	 ** Cancels every request in flight and waits for them all to complete,
+	 ** after which the kernel no longer references any memory they were
+	 ** given.  Returns false if that could not be confirmed, in which case
+	 ** such memory must not be freed.
+	 **/
+	bool Cancel (void);
+
+	int RingFd (void) { return ring_fd_; }
+
+	int StartRecv (void);
+	int StopRecv (void);
+
+	int QueueSend (uint64_t user_data, struct msghdr *message);
+	int Submit (void);
+
+	unsigned int Harvest (UringCompletion *completions, unsigned int max);
+	void Release (void);
+
+private:
+	int ArmRecv (void);
+	struct io_uring_sqe *GetSqe (void);
+	int Wait (void);
+
+	int fd_;
+	int ring_fd_;
+
+	void *sq_ring_;
+	size_t sq_ring_size_;
+	void *cq_ring_;
+	size_t cq_ring_size_;
+	struct io_uring_sqe *sqes_;
+	size_t sqes_size_;
+
+	unsigned int *sq_flags_;
+	unsigned int *sq_head_;
+	unsigned int *sq_tail_;
+	unsigned int *sq_array_;
+	unsigned int sq_mask_;
+	unsigned int sq_entries_;
+	unsigned int sq_local_tail_;
+
+	unsigned int *cq_head_;
+	unsigned int *cq_tail_;
+	unsigned int cq_mask_;
+	struct io_uring_cqe *cqes_;
+
+	struct io_uring_buf_ring *buf_ring_;
+	size_t buf_ring_size_;
+	char *buffers_;
+	size_t buffers_size_;
+	unsigned int buffer_count_;
+	unsigned int buffer_size_;
+	unsigned short buf_tail_;
+	std::vector<unsigned short> released_;
+
+	struct msghdr recv_message_;
+	bool recv_armed_;
+	bool recv_wanted_;
+
+	unsigned int in_flight_;
+};
+
+}; /* namespace raw */
+
+#endif /* RAW_HAVE_URING */
+
+#endif /* URING_H */